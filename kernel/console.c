@@ -20,6 +20,7 @@
 #include "memlayout.h"
 #include "loongarch.h"
 #include "defs.h"
+#include "list.h"
 #include "proc.h"
 
 #define BACKSPACE 0x100
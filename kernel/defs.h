@@ -5,10 +5,17 @@ struct inode;
 struct pipe;
 struct proc;
 struct spinlock;
+struct lockclass;
 struct sleeplock;
+struct rwlock;
+struct seqlock;
 struct stat;
 struct superblock;
-struct sharemem;
+struct kmem_cache;
+struct mm;
+struct shmobj;
+struct vma;
+struct mqattr;
 
 // console.c
 void            consoleinit(void);
@@ -23,11 +30,29 @@ void            printfinit(void);
 // spinlock.c
 void            acquire(struct spinlock*);
 int             holding(struct spinlock*);
-void            initlock(struct spinlock*, char*);
+void            initlockclass(struct spinlock*, char*, struct lockclass**);
+#define initlock(lk, name) \
+  do { static struct lockclass *_class; initlockclass((lk), (name), &_class); } while(0)
 void            release(struct spinlock*);
+void            lockstat(int);
+struct lockclass* lockclass(char*);
+#ifdef LOCKDEP
+void            lockdep_sleep(struct spinlock*);
+#endif
 void            push_off(void);
 void            pop_off(void);
-void            seminit(); 
+
+// rwlock.c
+void            initrwlock(struct rwlock*, char*);
+void            read_acquire(struct rwlock*);
+void            read_release(struct rwlock*);
+void            write_acquire(struct rwlock*);
+void            write_release(struct rwlock*);
+void            initseqlock(struct seqlock*, char*);
+uint            read_seqbegin(struct seqlock*);
+int             read_seqretry(struct seqlock*, uint);
+void            write_seqlock(struct seqlock*);
+void            write_sequnlock(struct seqlock*);
 
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
@@ -54,17 +79,18 @@ int             uartgetc(void);
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
-extern struct   spinlock tickslock;
+extern struct   seqlock tickslock;
 void            usertrapret(void);
 
 // proc.c
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
-int             growproc(int);
-void            proc_mapstacks(pagetable_t);
+int             growproc(int, int*);
 pagetable_t     proc_pagetable(struct proc *p);
-void            proc_freepagetable(pagetable_t, uint64);
+void            proc_freepagetable(pagetable_t, uint64, uint64);
+void            mmput(struct mm*);
+void            mmclearvma(struct mm*);
 int             kill(int);
 struct cpu*     mycpu(void);
 struct cpu*     getmycpu(void);
@@ -73,6 +99,8 @@ void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
 void            sleep(void*, struct spinlock*);
+void            sleepuntil(void*, struct spinlock*, uint);
+void            timerwake(uint);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
@@ -82,11 +110,17 @@ int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
 uint64          chpri(int,int);
 void            wakeup1p(void*);
-int             clone(void (*fcn)(void *), void *stack, void *arg);
-int             join(void);
+int             clone(void (*fcn)(void *), void *stack, void *arg, void *tls);
+int             join(int, uint64);
+int             detach(int, uint64);
 uint64          mygrowproc(int n);
+uint64          vmareserve(struct mm*, int, uint64, struct shmobj*);
+struct vma*     vmalookup(struct mm*, uint64);
+void            vmaremove(struct mm*, uint64);
 int             myreduceproc(uint64 address);
 int		getcpuid(void);
+int             setaffinity(int, uint);
+int             getaffinity(int);
 
 
 // swtch.S
@@ -97,10 +131,16 @@ void*           kalloc(void);
 void            kfree(void *);
 void            kinit(void);
 
+// slab.c
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+
 // vm.c
 void            tlbinit(void);
 void            vminit(void);
 pte_t *         walk(pagetable_t pagetable, uint64 va, int alloc);
+pte_t *         walkpmd(pagetable_t, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, uint64);
 pagetable_t     uvmcreate(void);
 void            uvminit(pagetable_t, uchar *, uint);
@@ -157,6 +197,8 @@ struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, int, uint64, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, int, uint64, uint, uint);
+int             readiblocks(struct inode*, uint, uint, int (*)(void*, char*, int), void*);
+int             writeiblocks(struct inode*, uint, uint, int (*)(void*, char*, int), void*);
 void            itrunc(struct inode*);
 
 // file.c
@@ -167,12 +209,20 @@ void            fileinit(void);
 int             fileread(struct file*, uint64, int n);
 int             filestat(struct file*, uint64 addr);
 int             filewrite(struct file*, uint64, int n);
+int             filesplice(struct file*, struct file*, int n);
+int             filetee(struct file*, struct file*, int n);
+int             filesend(struct file*, struct file*, int, int);
 
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, uint64, int);
 int             pipewrite(struct pipe*, uint64, int);
+int             pipegetsize(struct pipe*);
+int             pipesetsize(struct pipe*, int);
+int             pipefromi(struct pipe*, struct inode*, uint*, int);
+int             pipetoi(struct pipe*, struct inode*, uint*, int);
+int             pipemove(struct pipe*, struct pipe*, int, int);
 
 // extioi.c
 void            extioi_init(void);
@@ -192,22 +242,45 @@ int             exec(char*, char**);
 
 // sharemem.c
 void            sharememinit();
+int             shmopen(char*, int, int);
+int             shmunlink(char*);
+uint64          shmat(int);
+int             shmdt(uint64);
+void            shmdup(struct shmobj*);
+void            shmput(struct shmobj*);
+int             shmmap(pagetable_t, uint64, struct shmobj*);
+void            shmunmap(pagetable_t, uint64, struct shmobj*);
 void*           shmgetat(uint, uint);
 int             shmrefcount(uint);
-int             shmrelease(pde_t*, uint64, uint);
-void            shmaddcount(uint);
-int             shmkeyused(uint, uint);
 
 // messagequeue.c
 void 	mqinit();								//初始化系统的消息队列
 int     mqget(uint);							//申请使用某个消息队列
-int     msgsnd(uint, int, int, char *);				//发送消息
-int     msgrcv(uint, int, int, uint64);				//接收消息
-void    releasemq(uint);
-void    releasemq2(int);						//释放消息队列
-void    addmqcount(uint);
+int     mqopen(uint, struct mqattr*);			//按属性创建或打开消息队列
+int     mqstat(uint, struct mqattr*);			//队列属性、深度和最高水位
+int     msgsnd(uint, int, int, uint64, int, int);		//发送消息
+int     msgrcv(uint, int, int, uint64, int, int);		//接收消息
+int     msgsnd_batch(uint, uint64, int, int, int);		//一次发送多条消息
+int     msgrcv_batch(uint, int, uint64, int, int, int);	//一次接收多条消息
+int     msgsnd_pages(uint, int, uint64, int, int, int);	//整页发送，不拷贝
+uint64  msgrcv_pages(uint, int, uint64, int, int);		//接收到新映射的页
+void    releasemq2(uint64*);					//释放消息队列
+void    addmqcount(uint64*);
 int     copyoutstr(pagetable_t , uint64 , char *, uint64);	
 
 
+// sem.c
+void            seminit(void);
+int             semcreate(int);
+int             semfree(int);
+int             semwait(int, int, int, uint);
+int             sempost(int);
+int             semop(uint64, int);
+
+// futex.c
+void            futexinit(void);
+int             futex_wait(uint64, int);
+int             futex_wake(uint64, int);
+
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "loongarch.h"
 #include "spinlock.h"
+#include "list.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
@@ -20,6 +21,15 @@ exec(char *path, char **argv)
   struct proghdr ph;
   pagetable_t pagetable = 0, oldpagetable;
   struct proc *p = myproc();
+  struct mm *mm = p->mm;
+  int shared;
+
+  // other threads are still running in this address space.
+  acquire(&mm->lock);
+  shared = mm->refcount > 1;
+  release(&mm->lock);
+  if(shared)
+    return -1;
 
   begin_op();
 
@@ -62,7 +72,7 @@ exec(char *path, char **argv)
   ip = 0;
 
   p = myproc();
-  uint64 oldsz = p->sz;
+  uint64 oldsz = mm->sz;
 
   // Allocate two pages at the next page boundary.
   // Use the second as the user stack.
@@ -112,25 +122,26 @@ exec(char *path, char **argv)
   safestrcpy(p->name, last, sizeof(p->name));
     
   // Commit to the user image.
-  oldpagetable = p->pagetable;
-  p->pagetable = pagetable;
-  p->sz = sz;
+  mmclearvma(mm);
+  acquire(&mm->lock);
+  oldpagetable = mm->pagetable;
+  mm->pagetable = pagetable;
+  mm->sz = sz;
+  release(&mm->lock);
   p->trapframe->era = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
-  shmrelease(oldpagetable,p->shm,p->shmkeymask);
+  p->trapframe->tp = 0;  // no thread-local storage yet
 
-  proc_freepagetable(oldpagetable, oldsz);
+  proc_freepagetable(oldpagetable, p->tfva, oldsz);
 
-  p->shm = TRAPFRAME - 64*2*PGSIZE;
-  p->shmkeymask = 0;
-  releasemq(p->mqmask);
-  p->mqmask = 0;
+  releasemq2(p->mqmask);
+  memset(p->mqmask, 0, sizeof(p->mqmask));
 
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
   if(pagetable)
-    proc_freepagetable(pagetable, sz);
+    proc_freepagetable(pagetable, p->tfva, sz);
   if(ip){
     iunlockput(ip);
     end_op();
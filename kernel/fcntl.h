@@ -2,4 +2,8 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
-#define O_TRUNC   0x400
\ No newline at end of file
+#define O_TRUNC   0x400
+
+// fcntl() commands
+#define F_GETPIPE_SZ 1   // pipe capacity in bytes
+#define F_SETPIPE_SZ 2   // set it to at least arg bytes
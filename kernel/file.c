@@ -6,21 +6,27 @@
 #include "param.h"
 #include "fs.h"
 #include "spinlock.h"
+#include "rwlock.h"
 #include "sleeplock.h"
 #include "file.h"
 #include "stat.h"
+#include "list.h"
 #include "proc.h"
 
 struct devsw devsw[NDEV];
+
+// ftable.lock is write-held to take a file's ref to or from
+// zero; other reference counting read-holds it and changes
+// ref atomically.
 struct {
-  struct spinlock lock;
+  struct rwlock lock;
   struct file file[NFILE];
 } ftable;
 
 void
 fileinit(void)
 {
-  initlock(&ftable.lock, "ftable");
+  initrwlock(&ftable.lock, "ftable");
 }
 
 // Allocate a file structure.
@@ -29,15 +35,15 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
+  write_acquire(&ftable.lock);
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
-      release(&ftable.lock);
+      write_release(&ftable.lock);
       return f;
     }
   }
-  release(&ftable.lock);
+  write_release(&ftable.lock);
   return 0;
 }
 
@@ -45,11 +51,11 @@ filealloc(void)
 struct file*
 filedup(struct file *f)
 {
-  acquire(&ftable.lock);
+  read_acquire(&ftable.lock);
   if(f->ref < 1)
     panic("filedup");
-  f->ref++;
-  release(&ftable.lock);
+  __sync_fetch_and_add(&f->ref, 1);
+  read_release(&ftable.lock);
   return f;
 }
 
@@ -58,18 +64,28 @@ void
 fileclose(struct file *f)
 {
   struct file ff;
+  int ref;
 
-  acquire(&ftable.lock);
+  read_acquire(&ftable.lock);
+  while((ref = f->ref) > 1){
+    if(__sync_bool_compare_and_swap(&f->ref, ref, ref - 1)){
+      read_release(&ftable.lock);
+      return;
+    }
+  }
+  read_release(&ftable.lock);
+
+  write_acquire(&ftable.lock);
   if(f->ref < 1)
     panic("fileclose");
   if(--f->ref > 0){
-    release(&ftable.lock);
+    write_release(&ftable.lock);
     return;
   }
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
-  release(&ftable.lock);
+  write_release(&ftable.lock);
 
   if(ff.type == FD_PIPE){
     pipeclose(ff.pipe, ff.writable);
@@ -92,7 +108,7 @@ filestat(struct file *f, uint64 addr)
     ilock(f->ip);
     stati(f->ip, &st);
     iunlock(f->ip);
-    if(copyout(p->pagetable, addr, (char *)&st, sizeof(st)) < 0)
+    if(copyout(p->mm->pagetable, addr, (char *)&st, sizeof(st)) < 0)
       return -1;
     return 0;
   }
@@ -176,4 +192,76 @@ filewrite(struct file *f, uint64 addr, int n)
   }
 
   return ret;
-}
\ No newline at end of file
+}
+
+// Move up to n bytes from in to out without copying them
+// through user space. One end must be a pipe, the other a
+// pipe or an inode.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type == FD_PIPE && out->type == FD_PIPE)
+    return pipemove(in->pipe, out->pipe, n, 0);
+  if(in->type == FD_INODE && out->type == FD_PIPE)
+    return pipefromi(out->pipe, in->ip, &in->off, n);
+  if(in->type == FD_PIPE && out->type == FD_INODE)
+    return pipetoi(in->pipe, out->ip, &out->off, n);
+  return -1;
+}
+
+// Copy up to n bytes from pipe in to pipe out, leaving
+// them in in as well.
+int
+filetee(struct file *in, struct file *out, int n)
+{
+  if(in->readable == 0 || out->writable == 0 || n < 0)
+    return -1;
+  if(in->type != FD_PIPE || out->type != FD_PIPE)
+    return -1;
+  return pipemove(in->pipe, out->pipe, n, 1);
+}
+
+static int
+devput(void *arg, char *src, int n)
+{
+  struct file *f = arg;
+
+  return devsw[f->major].write(0, (uint64)src, n);
+}
+
+// Send n bytes of the inode open as in, starting at off, to
+// the pipe or device open as out, straight from the buffer
+// cache. If off is negative, start at in's offset and advance
+// it. Waits for room in a pipe until n bytes are sent or the
+// file ends. Returns the number sent, or -1.
+int
+filesend(struct file *out, struct file *in, int off, int n)
+{
+  uint o, *op;
+  int r, tot;
+
+  if(in->readable == 0 || out->writable == 0 || n < 0 || in->type != FD_INODE)
+    return -1;
+  if(n == 0)
+    return 0;
+  o = off;
+  op = off < 0 ? &in->off : &o;
+  if(out->type == FD_PIPE){
+    for(tot = 0; tot < n; tot += r)
+      if((r = pipefromi(out->pipe, in->ip, op, n - tot)) <= 0)
+        break;
+    return tot > 0 ? tot : r;
+  }
+  if(out->type == FD_DEVICE){
+    if(out->major < 0 || out->major >= NDEV || !devsw[out->major].write)
+      return -1;
+    ilock(in->ip);
+    if((r = readiblocks(in->ip, *op, n, devput, out)) > 0)
+      *op += r;
+    iunlock(in->ip);
+    return r;
+  }
+  return -1;
+}
@@ -15,6 +15,8 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "rwlock.h"
+#include "list.h"
 #include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -162,17 +164,20 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The itable.lock spin-lock protects the allocation of itable
-// entries. Since ip->ref indicates whether an entry is free,
+// The itable.lock reader-writer lock protects the allocation of
+// itable entries. Since ip->ref indicates whether an entry is free,
 // and ip->dev and ip->inum indicate which i-node an entry
 // holds, one must hold itable.lock while using any of those fields.
+// Lookups and reference counting that neither frees nor fills
+// an entry need only read-hold it, changing ref atomically;
+// taking ref to or from zero needs it write-held.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
 struct {
-  struct spinlock lock;
+  struct rwlock lock;
   struct inode inode[NINODE];
 } itable;
 
@@ -181,7 +186,7 @@ iinit()
 {
   int i = 0;
   
-  initlock(&itable.lock, "itable");
+  initrwlock(&itable.lock, "itable");
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&itable.inode[i].lock, "inode");
   }
@@ -244,14 +249,25 @@ iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
 
-  acquire(&itable.lock);
+  // Usually the inode is already in the table.
+  read_acquire(&itable.lock);
+  for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
+    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+      __sync_fetch_and_add(&ip->ref, 1);
+      read_release(&itable.lock);
+      return ip;
+    }
+  }
+  read_release(&itable.lock);
+
+  write_acquire(&itable.lock);
 
-  // Is the inode already in the table?
+  // Look again: it may have been added meanwhile.
   empty = 0;
   for(ip = &itable.inode[0]; ip < &itable.inode[NINODE]; ip++){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
       ip->ref++;
-      release(&itable.lock);
+      write_release(&itable.lock);
       return ip;
     }
     if(empty == 0 && ip->ref == 0)    // Remember empty slot.
@@ -267,7 +283,7 @@ iget(uint dev, uint inum)
   ip->inum = inum;
   ip->ref = 1;
   ip->valid = 0;
-  release(&itable.lock);
+  write_release(&itable.lock);
 
   return ip;
 }
@@ -277,9 +293,9 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&itable.lock);
-  ip->ref++;
-  release(&itable.lock);
+  read_acquire(&itable.lock);
+  __sync_fetch_and_add(&ip->ref, 1);
+  read_release(&itable.lock);
   return ip;
 }
 
@@ -332,7 +348,20 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&itable.lock);
+  int ref;
+
+  // Dropping a reference other than the last one
+  // cannot free the entry.
+  read_acquire(&itable.lock);
+  while((ref = ip->ref) > 1){
+    if(__sync_bool_compare_and_swap(&ip->ref, ref, ref - 1)){
+      read_release(&itable.lock);
+      return;
+    }
+  }
+  read_release(&itable.lock);
+
+  write_acquire(&itable.lock);
 
   if(ip->ref == 1 && ip->valid && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
@@ -341,7 +370,7 @@ iput(struct inode *ip)
     // so this acquiresleep() won't block (or deadlock).
     acquiresleep(&ip->lock);
 
-    release(&itable.lock);
+    write_release(&itable.lock);
 
     itrunc(ip);
     ip->type = 0;
@@ -350,11 +379,11 @@ iput(struct inode *ip)
 
     releasesleep(&ip->lock);
 
-    acquire(&itable.lock);
+    write_acquire(&itable.lock);
   }
 
   ip->ref--;
-  release(&itable.lock);
+  write_release(&itable.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -516,6 +545,81 @@ writei(struct inode *ip, int user_src, uint64 src, uint off, uint n)
   return tot;
 }
 
+// Like readi(), but instead of copying the data out, pass each
+// block's bytes to fn(arg, src, m) where they lie in the buffer
+// cache. fn returns how many bytes it took, or -1; taking fewer
+// than m ends the transfer. Caller must hold ip->lock.
+// Returns the number of bytes taken, or -1 if fn failed first.
+int
+readiblocks(struct inode *ip, uint off, uint n, int (*fn)(void*, char*, int), void *arg)
+{
+  uint tot, m;
+  int r;
+  struct buf *bp;
+
+  if(off > ip->size || off + n < off)
+    return 0;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=r, off+=r){
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    m = min(n - tot, BSIZE - off%BSIZE);
+    r = fn(arg, (char*)bp->data + (off % BSIZE), m);
+    brelse(bp);
+    if(r <= 0)
+      return tot > 0 ? tot : r;
+    if(r < m){
+      tot += r;
+      break;
+    }
+  }
+  return tot;
+}
+
+// Like writei(), but let fn(arg, dst, m) fill each block's bytes
+// in place in the buffer cache. fn returns how many bytes it
+// wrote, or -1; writing fewer than m ends the transfer. Caller
+// must hold ip->lock and be inside a transaction.
+// Returns the number of bytes written, or -1.
+int
+writeiblocks(struct inode *ip, uint off, uint n, int (*fn)(void*, char*, int), void *arg)
+{
+  uint tot, m;
+  int r;
+  struct buf *bp;
+
+  if(off > ip->size || off + n < off)
+    return -1;
+  if(off + n > MAXFILE*BSIZE)
+    return -1;
+
+  for(tot=0; tot<n; tot+=r, off+=r){
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    m = min(n - tot, BSIZE - off%BSIZE);
+    r = fn(arg, (char*)bp->data + (off % BSIZE), m);
+    if(r > 0)
+      log_write(bp);
+    brelse(bp);
+    if(r <= 0){
+      if(tot == 0 && r < 0)
+        return -1;
+      break;
+    }
+    if(r < m){
+      tot += r;
+      off += r;
+      break;
+    }
+  }
+
+  if(off > ip->size)
+    ip->size = off;
+  iupdate(ip);
+
+  return tot;
+}
+
 // Directories
 
 int
@@ -0,0 +1,125 @@
+// Futexes: sleep until a user word changes.
+//
+// futex_wait(addr, val) blocks only if *addr still holds val,
+// and futex_wake(addr, n) wakes up to n of those sleepers.
+// User-space locks built on top do their fast path with
+// atomic instructions and enter the kernel only when they
+// must block or wake someone.
+//
+// Waiters are keyed by the physical address of the word, so
+// threads sharing a page table and processes sharing memory
+// meet on the same queue. Each waiter lives on its own kernel
+// stack and sleeps on itself, so a wake touches only the
+// waiters it releases.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "loongarch.h"
+#include "list.h"
+#include "proc.h"
+#include "defs.h"
+
+#define NFUTEXQ 64
+#define FUTEXQ(pa) (&futexq[((pa) >> 2) % NFUTEXQ])
+
+struct futexq {
+  struct spinlock lock;
+  struct list head;
+} futexq[NFUTEXQ];
+
+struct futex_waiter {
+  struct list link;   // on futexq head, under its lock
+  uint64 key;         // physical address of the user word
+  int woken;
+};
+
+void
+futexinit(void)
+{
+  for(int i = 0; i < NFUTEXQ; i++){
+    initlock(&futexq[i].lock, "futex");
+    list_init(&futexq[i].head);
+  }
+}
+
+// Translate a user address to the physical address of
+// an aligned 32-bit word, or 0 if it is not mapped.
+static uint64
+futexkey(uint64 uaddr)
+{
+  uint64 pa;
+
+  if(uaddr % sizeof(int) != 0)
+    return 0;
+  if((pa = walkaddr(myproc()->mm->pagetable, PGROUNDDOWN(uaddr))) == 0)
+    return 0;
+  return pa + (uaddr - PGROUNDDOWN(uaddr));
+}
+
+// Sleep until woken by futex_wake() if the word at uaddr equals val.
+// Returns 0 when woken, -1 if the word differs, the address is
+// bad, or the process is killed.
+int
+futex_wait(uint64 uaddr, int val)
+{
+  struct proc *p = myproc();
+  struct futex_waiter w;
+  struct futexq *q;
+
+  if((w.key = futexkey(uaddr)) == 0)
+    return -1;
+  q = FUTEXQ(w.key);
+
+  // the check and the enqueue happen under q->lock, and
+  // futex_wake() takes q->lock, so a wake that follows a
+  // store to the word cannot slip in between them.
+  acquire(&q->lock);
+  if(*(volatile int*)(w.key | DMWIN_MASK) != val){
+    release(&q->lock);
+    return -1;
+  }
+  w.woken = 0;
+  list_add_tail(&q->head, &w.link);
+  while(!w.woken){
+    if(p->killed){
+      list_del(&w.link);
+      release(&q->lock);
+      return -1;
+    }
+    sleep(&w, &q->lock);
+  }
+  release(&q->lock);
+  return 0;
+}
+
+// Wake up to n waiters on the word at uaddr, oldest first.
+// Returns the number woken, or -1 if the address is bad.
+int
+futex_wake(uint64 uaddr, int n)
+{
+  struct futex_waiter *w;
+  struct futexq *q;
+  struct list *e, *next;
+  uint64 key;
+  int woken = 0;
+
+  if((key = futexkey(uaddr)) == 0)
+    return -1;
+  q = FUTEXQ(key);
+
+  acquire(&q->lock);
+  for(e = q->head.next; e != &q->head && woken < n; e = next){
+    next = e->next;
+    w = list_entry(e, struct futex_waiter, link);
+    if(w->key == key){
+      list_del(&w->link);
+      w->woken = 1;
+      wakeup(w);
+      woken++;
+    }
+  }
+  release(&q->lock);
+  return woken;
+}
@@ -0,0 +1,85 @@
+// Intrusive doubly-linked circular lists.
+//
+// A struct list is embedded in the object being linked and
+// list_entry() recovers the enclosing object. A list head is
+// a struct list that links to itself when empty. A detached
+// element is also self-linked, so list_empty() on an element
+// tells whether it is currently on some list.
+
+struct list {
+  struct list *next;
+  struct list *prev;
+};
+
+#define list_entry(e, type, member) \
+  ((type *)((char *)(e) - __builtin_offsetof(type, member)))
+
+static inline void
+list_init(struct list *l)
+{
+  l->next = l;
+  l->prev = l;
+}
+
+static inline int
+list_empty(struct list *l)
+{
+  return l->next == l;
+}
+
+// Insert e right after head.
+static inline void
+list_add(struct list *head, struct list *e)
+{
+  e->next = head->next;
+  e->prev = head;
+  head->next->prev = e;
+  head->next = e;
+}
+
+// Insert e right before head, i.e. at the end of the list.
+static inline void
+list_add_tail(struct list *head, struct list *e)
+{
+  e->next = head;
+  e->prev = head->prev;
+  head->prev->next = e;
+  head->prev = e;
+}
+
+// Unlink e and leave it self-linked.
+// Harmless if e is not on any list.
+static inline void
+list_del(struct list *e)
+{
+  e->prev->next = e->next;
+  e->next->prev = e->prev;
+  e->next = e;
+  e->prev = e;
+}
+
+// Remove and return the first element, or 0 if empty.
+static inline struct list *
+list_pop(struct list *head)
+{
+  struct list *e;
+
+  if(list_empty(head))
+    return 0;
+  e = head->next;
+  list_del(e);
+  return e;
+}
+
+// Move every element of from to the end of to, leaving from empty.
+static inline void
+list_splice_tail(struct list *to, struct list *from)
+{
+  if(list_empty(from))
+    return;
+  from->next->prev = to->prev;
+  to->prev->next = from->next;
+  from->prev->next = to;
+  to->prev = from->prev;
+  list_init(from);
+}
@@ -30,6 +30,15 @@ r_tp()
   return x;
 }
 
+// read the stable counter, which runs at a constant rate.
+static inline uint64
+r_time()
+{
+  uint64 x;
+  asm volatile("rdtime.d %0, $zero" : "=r" (x) );
+  return x;
+}
+
 static inline uint32
 r_csr_crmd()
 {
@@ -309,7 +318,7 @@ intr_off()
 #define PXSHIFT(level)  (PGSHIFT+(9*(level)))
 #define PX(level, va) ((((uint64) (va)) >> PXSHIFT(level)) & PXMASK)
 
-#define MAXVA (1L << (9 + 12 - 1)) //Lower half virtual address
+#define MAXVA (1L << (9 + 9 + 9 + 12 - 1)) //Lower half virtual address, 256GB
 
 typedef uint64 pte_t;
 typedef uint64 *pagetable_t;
\ No newline at end of file
@@ -40,6 +40,7 @@ main()
     ramdiskinit();   // emulated hard disk
 //printf("ramdiskinit\n");
     seminit(); //semaphore
+    futexinit(); //futex wait queues
     sharememinit();//sharemem
     mqinit();//massage queue
     userinit();      // first user process
@@ -29,10 +29,6 @@
 #define RAMBASE (0x90000000UL | DMWIN_MASK)
 #define RAMSTOP (RAMBASE + 128*1024*1024)
 
-// map kernel stacks beneath the trampframe,
-// each surrounded by invalid guard pages.
-#define KSTACK(p) (TRAPFRAME - ((p)+1)* 2*PGSIZE)
-
 // User memory layout.
 // Address zero first:
 //   text
@@ -40,7 +36,10 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   myalloc() regions and shared memory, placed downward from VMATOP
 //   invalid guard page
-//   KSRACK (used for kernel thread)
-//   TRAPFRAME (p->trapframe, used by the uservec)
+//   trapframes of threads 1..MAXTHREAD-1, one page each
+//   TRAPFRAME (p->trapframe of the first thread, used by the uservec)
 #define TRAPFRAME (MAXVA - PGSIZE)
+#define TRAPFRAMESLOT(i) (TRAPFRAME - (uint64)(i)*PGSIZE)
+#define VMATOP TRAPFRAMESLOT(MAXTHREAD)
@@ -2,269 +2,1006 @@
 #include "param.h"
 #include "loongarch.h"
 #include "spinlock.h"
+#include "list.h"
 #include "proc.h"
 #include "defs.h"
 #include "memlayout.h"
 
+#include "mq.h"
+
 int findkey(int key);
-int newmq(int key);
-int reloc(int mqid);
-
-struct msg {  		//消息结构体
-    struct msg *next;  					//指向下一个消息
-    long type;							// 消息类型
-    char *dataaddr;   					//数据地址，实际上等与msg+16
-    int  datasize;    					//消息长度
+int newmq(int key, struct mqattr *attr);
+
+// 每个消息队列的存储是一个环形缓冲区，由最多 MQMAXPAGES 个页组成，
+// 页在第一次用到时才分配。消息按发送顺序依次存放在 tail 处，每条
+// 消息是一个 msghdr 加上数据，长度按 8 字节对齐；缓冲区按字节环绕，
+// 消息可以跨页、跨过末尾，都经由 ringcopy() 等函数读写。
+//
+// msgsnd_pages() 发送的消息不拷贝数据，只带着发送者交出的物理
+// 页的地址，接收时把这些页映射给接收者。
+//
+// 按类型接收时不扫描整个队列：类型散列到 NMQHASH 个桶，每个桶
+// 把其中的消息按发送顺序用 hnext 串起来，所以发送和接收都是 O(1)。
+// 被接收的消息只标记为 dead，等 head 走到它时才回收空间；若
+// 空间不够而 dead 的字节足够，再原地整理一次缓冲区（很少发生）。
+//
+// 接收的 type 同 System V：大于 0 取这个类型最早的一条；0 取
+// 任意类型最早的一条，即 head 处的那条；小于 0 取类型不超过
+// -type 的最小类型中最早的一条，这要扫描所有桶。发送的类型
+// 必须大于 0。
+//
+// 队列按 key 散列查找，mqid 是 mqs[] 的下标。
+
+#define NMQHASH 16
+#define MQHASH(type) ((uint)(type) % NMQHASH)
+#define NKEYHASH 64
+#define KEYHASH(key) ((uint)(key) % NKEYHASH)
+#define MSGALIGN(n) (((n) + 7) & ~7)
+
+struct msghdr {     //消息头，数据紧随其后
+    int type;       // 消息类型
+    int size;       // 数据长度
+    int len;        // 整条消息占用的字节数
+    int hnext;      // 同一桶中下一条消息的偏移，-1 表示没有
+    int dead;       // 已被接收，等待回收
+    int npages;     // 大于 0 时数据不在队列中：随后是这么多个物理页地址
 };
- 
+
+#define HDRSZ MSGALIGN(sizeof(struct msghdr))
+
 struct mq {         //消息队列
     int key;        					//对应的key
     int status;    						//0代表未使用，1代表已使用
-    struct msg *msgs; 					//指向msg链表
-    int maxbytes;     					//一个消息队列最大为4k
-    int curbytes;     					//当前已使用字节数
+    struct mq *knext;                   //同一 key 桶中的下一个队列，或空闲链
+    char *pages[MQMAXPAGES];            //环形缓冲区的各页，未用到的为 0
+    int size;                           //缓冲区大小，页的整数倍
+    int msgsize;                        //最大消息长度
+    int maxmsg;                         //最多排队的消息数
+    int head;                           //最早的消息
+    int tail;                           //下一条消息的位置
+    int used;                           //head 到 tail 占用的字节数，含 dead
+    int deadbytes;                      //其中已被接收的字节数
+    int nmsg;                           //排队的消息数
+    int hwmsgs;                         //nmsg 的最高值
+    int hwbytes;                        //used - deadbytes 的最高值
+    int first[NMQHASH];                 //各桶最早的消息，-1 表示空
+    int last[NMQHASH];                  //各桶最新的消息
     int refcount;     					//引用数（进程数）
+    struct list readers;                //阻塞的接收者，先来的在前
+    struct list writers;                //阻塞的发送者，先来的在前
 };
 
-struct spinlock mqlock;   				//消息队列 锁
-struct mq mqs[MQMAX];  				//默认系统最多8个消息队列
-struct proc* wqueue[NPROC];   			//写阻塞队列
-int    wstart=0;      			//写阻塞队列指示下标
+// 阻塞的收发者在自己的内核栈上放一个 mqwaiter，挂在所等队列的
+// readers 或 writers 上并睡在它上面。发送只唤醒一个等这个类型的
+// 接收者，接收只唤醒放得下的发送者，都不会惊动别的队列。
+struct mqwaiter {
+    struct list link;   // 在 readers 或 writers 上，受 mqlock 保护
+    int type;           // 接收者：想要的类型
+    int mtype;          // 接收者：唤醒它的消息的类型
+    int len;            // 发送者：需要的字节数
+    int woken;
+    int flags;          // MSG_NOWAIT
+    int timeout;        // 大于 0 时最多等这么多 tick
+    uint deadline;
+};
 
-struct proc* rqueue[NPROC];  			//读阻塞队列
-int    rstart=0;     				//读阻塞队列指示下标
+static void mqclear(struct mq *q);
+
+struct spinlock mqlock;   				//消息队列 锁
+struct mq mqs[MQMAX];  				//系统最多 MQMAX 个消息队列
+struct mq *mqkeys[NKEYHASH];        //按 key 散列的队列
+struct mq *mqfree;                  //空闲的 mqs[] 项
 
 void mqinit()
 {
     printf("mqinit.\n");
     initlock(&mqlock,"mqlock");
-    for(int i =0;i<MQMAX;++i){
+    for(int i = MQMAX - 1; i >= 0; --i){
         mqs[i].status = 0;
+        list_init(&mqs[i].readers);
+        list_init(&mqs[i].writers);
+        mqs[i].knext = mqfree;
+        mqfree = &mqs[i];
     }
 }
 
-void addmqcount(uint mask)
+void addmqcount(uint64 *mask)
 {
-    //cprintf("addcount: %x.\n",mask);
     acquire(&mqlock);
-    for (int key = 0; key < MQMAX; key++)
+    for (int id = 0; id < MQMAX; id++)
     {
-        if(mask >> key & 1){
-            mqs[key].refcount++;
+        if(mask[id / 64] >> (id % 64) & 1){
+            mqs[id].refcount++;
         }
     }
     release(&mqlock);
 }
 
-int mqget(uint key)
+// 打开 key 对应的消息队列，不存在时按 attr 创建（attr 为 0 用默认值）
+int mqopen(uint key, struct mqattr *attr)
 {
     struct proc *proc = myproc();
     
     acquire(&mqlock);
     int idx = findkey(key);
     if(idx != -1){                          // 如果key对应的消息队列已经创建
-        if(!(proc->mqmask >> idx & 1)){     // 如果当前进程还未使用该消息队列
-            proc->mqmask |= 1 << idx;       // 标记本进程使用该消息队列
+        if(!(proc->mqmask[idx / 64] >> (idx % 64) & 1)){  // 如果当前进程还未使用该消息队列
+            proc->mqmask[idx / 64] |= 1UL << (idx % 64);  // 标记本进程使用该消息队列
             mqs[idx].refcount++;            // 消息队列的引用计数+1
         }
         release(&mqlock);
         return idx;
     }                                       // 对应key消息队列未创建则newmq创建
-    idx = newmq(key);                       // 创建消息队列
+    idx = newmq(key, attr);                 // 创建消息队列
     release(&mqlock);
     return idx;                             // 返回该消息队列在mqs []中的下标
 }
 
+int mqget(uint key)
+{
+    return mqopen(key, 0);
+}
+
 int findkey(int key)
 {
-    int idx =-1;
-    for(int i = 0;i<MQMAX;++i){
-        if(mqs[i].status != 0 && mqs[i].key == key){
-            idx = i;
-            break;
-        }
+    struct mq *q;
+
+    for(q = mqkeys[KEYHASH(key)]; q != 0; q = q->knext){
+        if(q->key == key)
+            return q - mqs;
     }
-    return idx;
+    return -1;
 }
 
-int newmq(int key)
+int newmq(int key, struct mqattr *attr)
 {
     struct proc *proc = myproc();
-    int idx =-1;
-    for(int i=0;i<MQMAX;++i){    				//查看mqs数组中是否有空闲项
-        if(mqs[i].status == 0){
-            idx = i;
-            break;
-        }
+    struct mq *q;
+    int size = PGSIZE, msgsize, maxmsg;
+
+    if(attr && attr->maxbytes > 0)
+        size = PGROUNDUP(attr->maxbytes);
+    if(size > MQMAXPAGES * PGSIZE)
+        return -1;
+    msgsize = size - HDRSZ;
+    if(attr && attr->msgsize > 0){
+        if(attr->msgsize > msgsize)
+            return -1;
+        msgsize = attr->msgsize;
     }
-    if(idx == -1){   						//消息队列全部用满，创建失败
+    maxmsg = size / HDRSZ;
+    if(attr && attr->maxmsg > 0)
+        maxmsg = attr->maxmsg;
+
+    if((q = mqfree) == 0){   						//消息队列全部用满，创建失败
         printf("newmq failed: can not get idx.\n");
         return -1;
     }
-    mqs[idx].msgs = (struct msg*)kalloc();  		//为消息池分配空间（1个页）
-    if(mqs[idx].msgs == 0){					//消息的存储空间不能为NULL
+    memset(q->pages, 0, sizeof(q->pages));
+    q->pages[0] = kalloc();              		//先分配第一页，其余用到时再分配
+    if(q->pages[0] == 0){					//消息的存储空间不能为NULL
         printf("newmq failed: can not alloc page.\n");
         return -1;
     }
-    mqs[idx].key = key;						//为该消息队列设置key值
-    mqs[idx].status = 1;						//标示为已启用
-    memset(mqs[idx].msgs,0,PGSIZE);     		//清空消息池
-    mqs[idx].msgs -> next = 0;         			//接下来都是初始化消息队列
-    mqs[idx].msgs -> datasize = 0;
-    mqs[idx].maxbytes = PGSIZE;
-    mqs[idx].curbytes = 16;
-    mqs[idx].refcount = 1;
-    proc->mqmask |= 1 << idx;    //修改当前进程的mqmask，表示使用中
-    return idx;
-}
-
-int reloc(int mqid)
-{
-    struct msg *pages = mqs[mqid].msgs;      //移动消息目标地址
-    struct msg *m  = pages;				//待移动消息
-    struct msg *t;
-    struct msg *pre = pages;
-    while (m != 0)
-    {
-        t = m->next;						//提前保存下一个待移动消息的地址
-        
-        memmove(pages, m, m->datasize+32);          //移动消息（包括原地拷贝）
-        pages->next = (struct msg *)((char *)pages + pages->datasize + 32);     // 修改下个消息指针
-        pages->dataaddr = ((char *)pages + 32);     //修改数据指针
-        pre = pages;					//记录当前消息指针
-        pages = pages->next;			//下个消息的目标位置（目的）
-        m = t;						//下一个待移动消息（源）
-    }
-    pre->next = 0;					//最后一个消息的next指针置0
+    mqfree = q->knext;
+    q->key = key;						//为该消息队列设置key值
+    q->status = 1;						//标示为已启用
+    q->knext = mqkeys[KEYHASH(key)];
+    mqkeys[KEYHASH(key)] = q;
+    q->size = size;
+    q->msgsize = msgsize;
+    q->maxmsg = maxmsg;
+    mqclear(q);
+    q->hwmsgs = q->hwbytes = 0;
+    q->refcount = 1;
+    proc->mqmask[(q - mqs) / 64] |= 1UL << ((q - mqs) % 64);    //修改当前进程的mqmask，表示使用中
+    return q - mqs;
+}
+
+// 清空队列
+static void
+mqclear(struct mq *q)
+{
+    q->head = q->tail = q->used = q->deadbytes = q->nmsg = 0;
+    for(int i = 0; i < NMQHASH; i++)
+        q->first[i] = q->last[i] = -1;
+}
+
+// 环形缓冲区 off 处最多 n 字节的一段，不跨页
+static char*
+ringptr(struct mq *q, int off, int *n)
+{
+    if(*n > PGSIZE - off % PGSIZE)
+        *n = PGSIZE - off % PGSIZE;
+    return q->pages[off / PGSIZE] + off % PGSIZE;
+}
+
+// 在环形缓冲区的 off 处读（out 为 0）或写 n 字节
+static void
+ringcopy(struct mq *q, int off, void *buf, int n, int out)
+{
+    int m;
+    char *p;
+
+    while(n > 0){
+        m = n;
+        p = ringptr(q, off, &m);
+        if(out)
+            memmove(p, buf, m);
+        else
+            memmove(buf, p, m);
+        buf = (char *)buf + m;
+        n -= m;
+        off = (off + m) % q->size;
+    }
+}
+
+// 在用户地址 addr 与环形缓冲区 off 处之间拷贝 n 字节
+static int
+ringuser(struct mq *q, int off, uint64 addr, int n, int out)
+{
+    pagetable_t pt = myproc()->mm->pagetable;
+    int m, r;
+    char *p;
+
+    while(n > 0){
+        m = n;
+        p = ringptr(q, off, &m);
+        if(out)
+            r = copyout(pt, addr, p, m);
+        else
+            r = copyin(pt, p, addr, m);
+        if(r < 0)
+            return -1;
+        addr += m;
+        n -= m;
+        off = (off + m) % q->size;
+    }
     return 0;
 }
 
-int msgsnd(uint mqid, int type, int sz, char *msg)
+// 在环形缓冲区内把 src 处 n 字节搬到 dst 处，dst 在 src 之前
+static void
+ringmove(struct mq *q, int dst, int src, int n)
 {
-    struct proc *proc = myproc();
-    if(mqid<0 || MQMAX<=mqid || mqs[mqid].status == 0){
+    int m, k;
+    char *d, *s;
+
+    while(n > 0){
+        m = n;
+        s = ringptr(q, src, &m);
+        k = m;
+        d = ringptr(q, dst, &k);
+        memmove(d, s, k);
+        n -= k;
+        src = (src + k) % q->size;
+        dst = (dst + k) % q->size;
+    }
+}
+
+static void
+gethdr(struct mq *q, int off, struct msghdr *m)
+{
+    ringcopy(q, off, m, sizeof(*m), 0);
+}
+
+static void
+puthdr(struct mq *q, int off, struct msghdr *m)
+{
+    ringcopy(q, off, m, sizeof(*m), 1);
+}
+
+// 把 off 处的消息挂到它所在桶的末尾
+static void
+msgindex(struct mq *q, int off, struct msghdr *m)
+{
+    struct msghdr t;
+    int h = MQHASH(m->type);
+
+    m->hnext = -1;
+    puthdr(q, off, m);
+    if(q->last[h] < 0){
+        q->first[h] = off;
+    } else {
+        gethdr(q, q->last[h], &t);
+        t.hnext = off;
+        puthdr(q, q->last[h], &t);
+    }
+    q->last[h] = off;
+}
+
+// 在 tail 处找 len 字节的空间，返回其偏移，没有则返回 -1。
+// 缺的页现在分配。
+static int
+msgplace(struct mq *q, int len)
+{
+    int off, pg, last;
+
+    if(len > q->size - q->used)
+        return -1;
+    off = q->tail;
+    last = (off + len - 1) % q->size / PGSIZE;
+    for(pg = off / PGSIZE; ; pg = (pg + 1) % (q->size / PGSIZE)){
+        if(q->pages[pg] == 0 && (q->pages[pg] = kalloc()) == 0)
+            return -1;
+        if(pg == last)
+            break;
+    }
+    q->tail = (off + len) % q->size;
+    q->used += len;
+    return off;
+}
+
+// 回收 head 处已被接收的消息
+static void
+msgreclaim(struct mq *q)
+{
+    struct msghdr m;
+
+    while(q->used > 0){
+        gethdr(q, q->head, &m);
+        if(!m.dead)
+            break;
+        q->head = (q->head + m.len) % q->size;
+        q->used -= m.len;
+        q->deadbytes -= m.len;
+    }
+    if(q->used == 0)
+        q->head = q->tail = 0;
+}
+
+// 把未接收的消息依次前移到 head 处，挤掉 dead 的空间，重建索引。
+// 只在空间不足而 dead 的字节足够时调用。
+static void
+msgcompact(struct mq *q)
+{
+    struct msghdr m;
+    int rd, wr, n, live;
+
+    rd = wr = q->head;
+    live = 0;
+    for(n = q->used; n > 0; n -= m.len){
+        gethdr(q, rd, &m);
+        if(!m.dead){
+            if(wr != rd)
+                ringmove(q, wr, rd, m.len);
+            wr = (wr + m.len) % q->size;
+            live += m.len;
+        }
+        rd = (rd + m.len) % q->size;
+    }
+    for(int i = 0; i < NMQHASH; i++)
+        q->first[i] = q->last[i] = -1;
+    for(rd = q->head, n = live; n > 0; n -= m.len){
+        gethdr(q, rd, &m);
+        msgindex(q, rd, &m);
+        rd = (rd + m.len) % q->size;
+    }
+    q->tail = wr;
+    q->used = live;
+    q->deadbytes = 0;
+}
+
+static void
+waitinit(struct mqwaiter *w, int flags, int timeout)
+{
+    w->woken = 0;
+    w->flags = flags;
+    w->timeout = timeout;
+    w->deadline = ticks + timeout;
+}
+
+// 不再等了：MSG_NOWAIT、超时或被 kill
+static int
+giveup(struct mqwaiter *w)
+{
+    if(w->flags & MSG_NOWAIT)
+        return 1;
+    if(w->timeout > 0 && (int)(ticks - w->deadline) >= 0)
+        return 1;
+    return myproc()->killed;
+}
+
+// 睡在 q 的 waitq 上，直到被唤醒；放弃时返回 -1。
+// 被唤醒过的排到最前面，不失去先来的位置；若它接着放弃，
+// woken 仍为 1，调用者要把这次唤醒让给下一个。
+static int
+mqwait(struct list *waitq, struct mqwaiter *w)
+{
+    if(giveup(w))
         return -1;
+    if(w->woken)
+        list_add(waitq, &w->link);
+    else
+        list_add_tail(waitq, &w->link);
+    w->woken = 0;
+    while(!w->woken){
+        if(giveup(w)){
+            list_del(&w->link);
+            return -1;
+        }
+        if(w->timeout > 0)
+            sleepuntil(w, &mqlock, w->deadline);
+        else
+            sleep(w, &mqlock);
     }
+    return 0;
+}
+
+static void
+mqwake(struct mqwaiter *w)
+{
+    list_del(&w->link);
+    w->woken = 1;
+    wakeup(w);
+}
+
+// 想要 want 的接收者是否接受 type 类型的消息
+static int
+msgmatch(int want, int type)
+{
+    if(want > 0)
+        return type == want;
+    return want == 0 || type <= -want;
+}
+
+// 刚发来一条 type 类型的消息：唤醒最早等它的一个接收者
+static void
+wakereader(struct mq *q, int type)
+{
+    struct list *e;
+    struct mqwaiter *w;
 
-    char *data = msg;
-    printf("data:%s\n", data);
- 
-    if(mqs[mqid].msgs == 0){
-        printf("msgsnd failed: msgs == 0.\n");
+    for(e = q->readers.next; e != &q->readers; e = e->next){
+        w = list_entry(e, struct mqwaiter, link);
+        if(msgmatch(w->type, type)){
+            w->mtype = type;
+            mqwake(w);
+            return;
+        }
+    }
+}
+
+// 刚腾出了空间：按先后唤醒放得下的发送者
+static void
+wakewriters(struct mq *q)
+{
+    struct mqwaiter *w;
+    int avail = q->size - q->used + q->deadbytes;
+    int slots = q->maxmsg - q->nmsg;
+
+    while(!list_empty(&q->writers) && slots > 0){
+        w = list_entry(q->writers.next, struct mqwaiter, link);
+        if(w->len > avail)
+            break;
+        avail -= w->len;
+        slots--;
+        mqwake(w);
+    }
+}
+
+static struct mq*
+getmq(uint mqid)
+{
+    if(MQMAX <= mqid || mqs[mqid].status == 0)
+        return 0;
+    return &mqs[mqid];
+}
+
+// 为一条 len 字节的消息在 tail 处找空间，返回其偏移；
+// 消息条数已满或空间不够返回 -1
+static int
+msgroom(struct mq *q, int len)
+{
+    int off;
+
+    if(q->nmsg >= q->maxmsg)
         return -1;
+    off = msgplace(q, len);
+    if(off < 0 && q->size - q->used + q->deadbytes >= len){
+        msgcompact(q);
+        off = msgplace(q, len);
     }
- 
-    acquire(&mqlock);
- 
-    while(1){               //一直循环直到发送成功
-        if(mqs[mqid].curbytes + sz + 16 <= mqs[mqid].maxbytes){ //如果剩余空间充裕
-            struct msg *m = mqs[mqid].msgs;
-            while(m->next != 0){           //找到队尾最后一个空闲消息区
-                m = m -> next;
-            }                               //退出循环时，m->next==0标示空闲消息区
-            m->next = (void *)m + m->datasize + 32; //计算用于存储消息的起始位置
-            m = m -> next;              //m为本消息存储空间起点
-            m->type = type;             //填写本消息type
-            m->next = 0;                    //本消息暂无后续消息
-            m->dataaddr = (char *)m + 32;   //数据区
-            m->datasize = sz;               //数据长度
-
-            memmove(m->dataaddr, msg, sz);  //拷贝消息数据
-             
-            mqs[mqid].curbytes += (sz+32);  //可用空间缩减
- 
-            for(int i=0; i<rstart; i++)     //唤醒所有读阻塞进程
-            {
-                wakeup(rqueue[i]);
+    return off;
+}
+
+// 作废 msgroom() 给出而没有填好的 off 处的消息
+static void
+msgdrop(struct mq *q, int off, struct msghdr *m)
+{
+    m->dead = 1;
+    puthdr(q, off, m);
+    q->deadbytes += m->len;
+    msgreclaim(q);
+}
+
+// off 处的消息 m 已经填好：挂上索引，唤醒一个等它的接收者
+static void
+msgcommit(struct mq *q, int off, struct msghdr *m)
+{
+    msgindex(q, off, m);
+    q->nmsg++;
+    if(q->nmsg > q->hwmsgs)
+        q->hwmsgs = q->nmsg;
+    if(q->used - q->deadbytes > q->hwbytes)
+        q->hwbytes = q->used - q->deadbytes;
+    wakereader(q, m->type);
+}
+
+// 把 sz 字节的用户数据 addr 作为一条 type 类型的消息放入队列。
+// 返回 0；放不下返回 -1；addr 无效返回 -2。
+static int
+msgput(struct mq *q, int type, int sz, uint64 addr)
+{
+    struct msghdr m;
+    int off, len = HDRSZ + MSGALIGN(sz);
+
+    if((off = msgroom(q, len)) < 0)
+        return -1;
+    m.type = type;              //填写本消息type
+    m.size = sz;                //数据长度
+    m.len = len;
+    m.dead = 0;
+    m.npages = 0;
+    if(ringuser(q, (off + HDRSZ) % q->size, addr, sz, 0) < 0){
+        msgdrop(q, off, &m);    //拷贝失败，作废这条消息
+        return -2;
+    }
+    msgcommit(q, off, &m);
+    return 0;
+}
+
+// off 处的消息带着的第 i 页的物理地址
+static uint64
+msgpage(struct mq *q, int off, int i)
+{
+    uint64 pa;
+
+    ringcopy(q, (off + HDRSZ + i * sizeof(pa)) % q->size, &pa, sizeof(pa), 0);
+    return pa;
+}
+
+// 找一条 type 所要的消息，返回其偏移，*prevp 为同一桶中它的
+// 前一条（-1 表示它是第一条）；没有则返回 -1
+static int
+msgfind(struct mq *q, int type, int *prevp)
+{
+    struct msghdr m;
+    int h, off, prev, best = -1, btype = 0;
+
+    *prevp = -1;
+    if(q->nmsg == 0)
+        return -1;
+    if(type == 0)               //head 处总是最早的未接收消息，也是它桶中的第一条
+        return q->head;
+    if(type > 0){
+        prev = -1;
+        for(off = q->first[MQHASH(type)]; off >= 0; prev = off, off = m.hnext){
+            gethdr(q, off, &m);
+            if(m.type == type){
+                *prevp = prev;
+                return off;
+            }
+        }
+        return -1;
+    }
+    //同一类型在同一个桶中按先后排列，取每种类型第一次出现的
+    for(h = 0; h < NMQHASH; h++){
+        prev = -1;
+        for(off = q->first[h]; off >= 0; prev = off, off = m.hnext){
+            gethdr(q, off, &m);
+            if(m.type <= -type && (best < 0 || m.type < btype)){
+                best = off;
+                btype = m.type;
+                *prevp = prev;
             }
-            rstart = 0;                     //读阻塞队列置空
+        }
+    }
+    return best;
+}
+
+// 把 off 处的消息 m 从桶中摘下并标记为 dead，
+// 空间等 head 走到这里时回收
+static void
+msgunlink(struct mq *q, int off, int prev, struct msghdr *m)
+{
+    struct msghdr pm;
+    int h = MQHASH(m->type);
 
-            release(&mqlock);
+    if(prev < 0){
+        q->first[h] = m->hnext;
+    } else {
+        gethdr(q, prev, &pm);
+        pm.hnext = m->hnext;
+        puthdr(q, prev, &pm);
+    }
+    if(q->last[h] == off)
+        q->last[h] = prev;
+    m->dead = 1;
+    puthdr(q, off, m);
+    q->deadbytes += m->len;
+    q->nmsg--;
+    msgreclaim(q);
+}
+
+// 取走 off 处的消息，最多拷贝 sz 字节到用户地址 addr，*typep 为
+// 它的类型。返回拷贝的字节数；addr 无效返回 -1，消息留在队列中。
+// 消息带着的页拷贝后释放。
+static int
+msgtake(struct mq *q, int off, int prev, int sz, uint64 addr, int *typep)
+{
+    pagetable_t pt = myproc()->mm->pagetable;
+    struct msghdr m;
+    int i, n, k;
+
+    gethdr(q, off, &m);
+    *typep = m.type;
+    n = sz < m.size ? sz : m.size;
+    if(m.npages == 0){
+        if(ringuser(q, (off + HDRSZ) % q->size, addr, n, 1) < 0)
+            return -1;
+    } else {
+        for(i = 0; i * PGSIZE < n; i++){
+            k = n - i * PGSIZE < PGSIZE ? n - i * PGSIZE : PGSIZE;
+            if(copyout(pt, addr + i * PGSIZE, (char *)(msgpage(q, off, i) | DMWIN_MASK), k) < 0)
+                return -1;
+        }
+        for(i = 0; i < m.npages; i++)
+            kfree((void *)(msgpage(q, off, i) | DMWIN_MASK));
+    }
+    msgunlink(q, off, prev, &m);
+    return n;
+}
+
+// 在 mm 中新登记一块内存放 off 处消息 m 的数据，返回其地址；
+// 失败返回 0，消息不变。带着页的消息直接映射这些页，普通消息
+// 拷贝进新分配的页。调用者持有 mm->lock。
+static uint64
+msgmap(struct mq *q, int off, struct msghdr *m, struct mm *mm)
+{
+    uint64 va;
+    int i, n;
+
+    if(m->npages == 0){
+        n = m->size > 0 ? m->size : 1;
+        if((va = vmareserve(mm, n, PGSIZE, 0)) == 0)
+            return 0;
+        if(uvmalloc(mm->pagetable, va, va + n) == 0){
+            vmaremove(mm, va);
             return 0;
-        } else {                            //空间不足，进程睡眠在wqueue阻塞队列
-            printf("msgsnd: can not alloc: pthread: %d sleep.\n",proc->pid);
-            wqueue[wstart++] = proc;        //环形队列
+        }
+        if(ringuser(q, (off + HDRSZ) % q->size, va, m->size, 1) < 0){
+            mydeallocuvm(mm->pagetable, va, va + n);
+            vmaremove(mm, va);
+            return 0;
+        }
+        return va;
+    }
+    if((va = vmareserve(mm, m->npages * PGSIZE, PGSIZE, 0)) == 0)
+        return 0;
+    for(i = 0; i < m->npages; i++){
+        if(mappages(mm->pagetable, va + i * PGSIZE, PGSIZE, msgpage(q, off, i),
+                    PTE_P | PTE_W | PTE_PLV | PTE_MAT | PTE_D) < 0){
+            if(i > 0)
+                uvmunmap(mm->pagetable, va, i, 0);
+            vmaremove(mm, va);
+            return 0;
+        }
+    }
+    return va;
+}
+
+// 发送 sz 字节的用户数据 addr。队列满时等待，除非 flags 有
+// MSG_NOWAIT；timeout 大于 0 时最多等 timeout 个 tick。
+int
+msgsnd(uint mqid, int type, int sz, uint64 addr, int flags, int timeout)
+{
+    struct mq *q;
+    struct mqwaiter w;
+    int r = -1;
+
+    if((q = getmq(mqid)) == 0 || type <= 0 || sz < 0)
+        return -1;
+    w.len = HDRSZ + MSGALIGN(sz);
+    waitinit(&w, flags, timeout);
 
-            sleep(proc,&mqlock);
+    acquire(&mqlock);
+    if(sz <= q->msgsize){               //不超过最大消息长度
+        while((r = msgput(q, type, sz, addr)) == -1){
+            //空间不足，睡在本队列的 writers 上
+            if(mqwait(&q->writers, &w) < 0){
+                if(w.woken)
+                    wakewriters(q);     //刚被唤醒过，让给下一个
+                break;
+            }
         }
-        
     }
+    release(&mqlock);
+    return r == 0 ? 0 : -1;
+}
+
+// 接收一条 type 所要的消息（见文件开头），最多拷贝 sz 字节到
+// addr，返回拷贝的字节数。等待的规则同 msgsnd()。
+int
+msgrcv(uint mqid, int type, int sz, uint64 addr, int flags, int timeout)
+{
+    struct mq *q;
+    struct mqwaiter w;
+    int off, prev, mtype, n = -1;
 
- 	return -1;
+    if((q = getmq(mqid)) == 0 || sz < 0)
+        return -1;
+    w.type = type;
+    waitinit(&w, flags, timeout);
+
+    acquire(&mqlock);
+    while((off = msgfind(q, type, &prev)) < 0){
+        //没有想要的消息，睡在本队列的 readers 上
+        if(mqwait(&q->readers, &w) < 0){
+            if(w.woken)
+                wakereader(q, w.mtype); //刚被唤醒过，让给下一个
+            break;
+        }
+    }
+    if(off >= 0){
+        if((n = msgtake(q, off, prev, sz, addr, &mtype)) >= 0)
+            wakewriters(q);             //唤醒放得下的发送者
+        else
+            wakereader(q, mtype);       //消息还在，让给下一个
+    }
+    release(&mqlock);
+    return n;
 }
 
+// 依次发送用户数组 uv 中的 n 条消息（最多 MSGBATCH 条），返回
+// 发送的条数。只为第一条等待，之后放不下或出错就提前返回。
 int
-msgrcv(uint mqid, int type, int sz, uint64 addr)
+msgsnd_batch(uint mqid, uint64 uv, int n, int flags, int timeout)
 {
-    struct proc *proc = myproc();
-    if(mqid<0 || MQMAX<=mqid || mqs[mqid].status ==0){
+    pagetable_t pt = myproc()->mm->pagetable;
+    struct mq *q;
+    struct msgvec v;
+    struct mqwaiter w;
+    int i, r;
+
+    if((q = getmq(mqid)) == 0 || n <= 0)
         return -1;
+    if(n > MSGBATCH)
+        n = MSGBATCH;
+    waitinit(&w, flags, timeout);
+
+    acquire(&mqlock);
+    for(i = 0; i < n; i++){
+        if(copyin(pt, (char*)&v, uv + i * sizeof(v), sizeof(v)) < 0
+        || v.type <= 0 || v.size < 0 || v.size > q->msgsize)
+            break;
+        w.len = HDRSZ + MSGALIGN(v.size);
+        while((r = msgput(q, v.type, v.size, (uint64)v.data)) == -1 && i == 0){
+            if(mqwait(&q->writers, &w) < 0){
+                if(w.woken)
+                    wakewriters(q);
+                break;
+            }
+        }
+        if(r < 0)
+            break;
     }
- 
- 
- 
+    release(&mqlock);
+    return i > 0 ? i : -1;
+}
+
+// 接收最多 n 条 type 所要的消息到用户数组 uv，填写每条的类型和
+// 长度，返回接收的条数。只为第一条等待。
+int
+msgrcv_batch(uint mqid, int type, uint64 uv, int n, int flags, int timeout)
+{
+    pagetable_t pt = myproc()->mm->pagetable;
+    struct mq *q;
+    struct msgvec v;
+    struct mqwaiter w;
+    int i, off, prev;
+
+    if((q = getmq(mqid)) == 0 || n <= 0)
+        return -1;
+    if(n > MSGBATCH)
+        n = MSGBATCH;
+    w.type = type;
+    waitinit(&w, flags, timeout);
+
     acquire(&mqlock);
-    
-    while(1){
-        struct msg *m = mqs[mqid].msgs->next;
-        struct msg *pre = mqs[mqid].msgs;
-        while (m != 0)
-        {
-            if(m->type == type){        //找到要读取的消息类型
-                copyoutstr(proc->pagetable, addr, m->dataaddr, sz);
-
-                pre->next = m->next;    //将已读取的消息从消息队列中删除
-                mqs[mqid].curbytes -= (m->datasize + 32);   //释放消息空间
-                reloc(mqid);            //重新整理内存
-
-                for(int i=0; i<wstart; i++) //唤醒写阻塞进程
-                {
-                    wakeup(wqueue[i]);
-                }
-                wstart = 0;                 //写阻塞队列置空
- 
-                release(&mqlock);
-                return 0;
+    for(i = 0; i < n; i++){
+        if(copyin(pt, (char*)&v, uv + i * sizeof(v), sizeof(v)) < 0 || v.size < 0)
+            break;
+        while((off = msgfind(q, type, &prev)) < 0 && i == 0){
+            if(mqwait(&q->readers, &w) < 0){
+                if(w.woken)
+                    wakereader(q, w.mtype);
+                break;
             }
-            pre = m;
-            m = m->next;
         }
-        printf("msgrcv: can not read: pthread: %d sleep.\n",proc->pid);
-        rqueue[rstart++] = proc;
-        sleep(proc,&mqlock);
+        if(off < 0)
+            break;
+        if((v.size = msgtake(q, off, prev, v.size, (uint64)v.data, &v.type)) < 0){
+            wakereader(q, v.type);
+            break;
+        }
+        //消息已取走，即使写不回去也算收到了
+        copyout(pt, uv + i * sizeof(v), (char*)&v, sizeof(v));
     }
-    return -1;
+    if(i > 0)
+        wakewriters(q);                 //一次唤醒放得下的发送者
+    release(&mqlock);
+    return i > 0 ? i : -1;
 }
 
-void
-rmmq(int mqid)
+// 把 addr 开头的 myalloc() 内存块作为一条消息发送，不拷贝：它的
+// 页从本进程的页表上摘下由消息带走，这一块随之不再存在。len 是
+// 数据的字节数，不超过块的长度。等待的规则同 msgsnd()。
+int
+msgsnd_pages(uint mqid, int type, uint64 addr, int len, int flags, int timeout)
+{
+    struct mm *mm = myproc()->mm;
+    struct mq *q;
+    struct msghdr m;
+    struct mqwaiter w;
+    struct vma *v;
+    uint64 pa;
+    int i, n, ok, off = -1;
+
+    if((q = getmq(mqid)) == 0 || type <= 0 || len < 0 || addr % PGSIZE != 0)
+        return -1;
+    acquire(&mm->lock);
+    n = (v = vmalookup(mm, addr)) != 0 && v->shm == 0 ? v->length : -1;
+    release(&mm->lock);
+    if(n <= 0 || len > n)
+        return -1;
+    m.type = type;
+    m.size = len;
+    m.npages = PGROUNDUP(n) / PGSIZE;
+    m.len = HDRSZ + MSGALIGN(m.npages * sizeof(pa));
+    m.dead = 0;
+    w.len = m.len;
+    waitinit(&w, flags, timeout);
+
+    acquire(&mqlock);
+    if(m.npages * sizeof(pa) <= q->msgsize){
+        while((off = msgroom(q, m.len)) < 0){
+            if(mqwait(&q->writers, &w) < 0){
+                if(w.woken)
+                    wakewriters(q);
+                break;
+            }
+        }
+    }
+    if(off >= 0){
+        acquire(&mm->lock);
+        v = vmalookup(mm, addr);        //等待时可能被别的线程释放了
+        ok = v != 0 && v->shm == 0 && v->length == n;
+        for(i = 0; ok && i < m.npages; i++){
+            if((pa = walkaddr(mm->pagetable, addr + i * PGSIZE)) == 0)
+                ok = 0;
+            ringcopy(q, (off + HDRSZ + i * sizeof(pa)) % q->size, &pa, sizeof(pa), 1);
+        }
+        if(ok){
+            uvmunmap(mm->pagetable, addr, m.npages, 0);
+            vmaremove(mm, addr);
+        }
+        release(&mm->lock);
+        if(ok)
+            msgcommit(q, off, &m);
+        else
+            msgdrop(q, off, &m);
+        off = ok ? off : -1;
+    }
+    release(&mqlock);
+    return off >= 0 ? 0 : -1;
+}
+
+// 接收一条 type 所要的消息，放进本进程新的 myalloc() 内存块，
+// 返回块的地址，数据的字节数写到用户地址 ulen。msgsnd_pages()
+// 发来的页直接映射过来，不拷贝。块用 myfree() 释放，也可以再用
+// msgsnd_pages() 转发。等待的规则同 msgsnd()，失败返回 0。
+uint64
+msgrcv_pages(uint mqid, int type, uint64 ulen, int flags, int timeout)
 {
-    //cprintf("rmmq: %d.\n",mqid);
-    kfree((char *)mqs[mqid].msgs);  //回收物理内存
-    mqs[mqid].status = 0;
+    struct mm *mm = myproc()->mm;
+    struct mq *q;
+    struct msghdr m;
+    struct mqwaiter w;
+    uint64 va = 0;
+    int off, prev;
+
+    if((q = getmq(mqid)) == 0)
+        return 0;
+    w.type = type;
+    waitinit(&w, flags, timeout);
+
+    acquire(&mqlock);
+    while((off = msgfind(q, type, &prev)) < 0){
+        if(mqwait(&q->readers, &w) < 0){
+            if(w.woken)
+                wakereader(q, w.mtype);
+            break;
+        }
+    }
+    if(off >= 0){
+        gethdr(q, off, &m);
+        acquire(&mm->lock);
+        va = msgmap(q, off, &m, mm);
+        release(&mm->lock);
+        if(va != 0){
+            msgunlink(q, off, prev, &m);
+            wakewriters(q);
+        } else {
+            wakereader(q, m.type);      //消息还在，让给下一个
+        }
+    }
+    release(&mqlock);
+    if(va != 0 && ulen != 0)
+        copyout(mm->pagetable, ulen, (char *)&m.size, sizeof(m.size));
+    return va;
 }
- 
+
+// 报告队列的属性、当前深度和最高水位
+int
+mqstat(uint mqid, struct mqattr *attr)
+{
+    struct mq *q;
+
+    if(mqid<0 || MQMAX<=mqid)
+        return -1;
+    q = &mqs[mqid];
+    acquire(&mqlock);
+    if(q->status == 0){
+        release(&mqlock);
+        return -1;
+    }
+    attr->maxbytes = q->size;
+    attr->msgsize = q->msgsize;
+    attr->maxmsg = q->maxmsg;
+    attr->key = q->key;
+    attr->curmsgs = q->nmsg;
+    attr->curbytes = q->used - q->deadbytes;
+    attr->hwmsgs = q->hwmsgs;
+    attr->hwbytes = q->hwbytes;
+    release(&mqlock);
+    return 0;
+}
+
 void
-releasemq(uint key)
+rmmq(int mqid)
 {
-   //cprintf("releasemq: %d.\n",key);
-  int idx= findkey(key);
-  if (idx!=-1){
-      acquire(&mqlock);
-          mqs[idx].refcount--;   //引用数目减1
-            if(mqs[idx].refcount == 0)  //引用数目为0时候需要回收物理内存
-                rmmq(idx);
-       release(&mqlock);
-     }
+    struct mq *q = &mqs[mqid], **pp;
+    struct msghdr m;
+    int off, n;
+
+    //还没被接收的消息带着的页
+    for(off = q->head, n = q->used; n > 0; off = (off + m.len) % q->size, n -= m.len){
+        gethdr(q, off, &m);
+        if(!m.dead)
+            for(int i = 0; i < m.npages; i++)
+                kfree((void *)(msgpage(q, off, i) | DMWIN_MASK));
+    }
+
+    for(int i = 0; i < MQMAXPAGES; i++){  //回收物理内存
+        if(q->pages[i])
+            kfree(q->pages[i]);
+        q->pages[i] = 0;
+    }
+    for(pp = &mqkeys[KEYHASH(q->key)]; *pp != q; pp = &(*pp)->knext)
+        ;
+    *pp = q->knext;
+    q->status = 0;
+    q->knext = mqfree;
+    mqfree = q;
 }
 
 void
-releasemq2(int mask)
+releasemq2(uint64 *mask)
 {
-    //cprintf("releasemq: %x.\n",mask);
     acquire(&mqlock);
     for(int id = 0;id<MQMAX;++id){
-        if( mask >> id & 0x1){
+        if(mask[id / 64] >> (id % 64) & 0x1){
             mqs[id].refcount--;   //引用数目减1
             if(mqs[id].refcount == 0){  //引用数目为0时候需要回收物理内存
                 rmmq(id);
@@ -273,4 +1010,3 @@ releasemq2(int mask)
     }
     release(&mqlock);
 }
-
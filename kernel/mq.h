@@ -0,0 +1,27 @@
+// Message queue attributes, for mqopen() and mqstat().
+struct mqattr {
+  int maxbytes;   // capacity in bytes, rounded up to whole pages
+  int msgsize;    // largest message, in bytes
+  int maxmsg;     // most messages queued at once
+
+  // set by mqstat() only:
+  int key;
+  int curmsgs;    // messages queued now
+  int curbytes;   // bytes queued now, headers included
+  int hwmsgs;     // most messages ever queued
+  int hwbytes;    // most bytes ever queued
+};
+
+#define MQMAXPAGES 16    // largest capacity, in pages
+
+// msgsnd()/msgrcv() flags
+#define MSG_NOWAIT 0x1   // fail instead of waiting
+
+// One message of msgsnd_batch() or msgrcv_batch().
+struct msgvec {
+  int type;       // msgrcv_batch() sets it to the type received
+  int size;       // bytes to send; or buffer size in, bytes received out
+  char *data;
+};
+
+#define MSGBATCH 64      // most messages per batch call
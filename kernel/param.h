@@ -1,4 +1,5 @@
-#define NPROC        32  // maximum number of processes
+#define NPROC       512  // maximum number of processes
+#define MAXTHREAD    64  // maximum threads sharing one address space
 #define NCPU          1  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
@@ -9,6 +10,8 @@
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
+#define FSSIZE       3000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
-#define MQMAX 8
+#define MQMAX 256
+#define NVMA         32  // myalloc() regions and shm attachments per address space
+#define NSHM         64  // shared memory objects
@@ -3,22 +3,57 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "list.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
 #include "file.h"
 
-#define PIPESIZE 512
+// A pipe's buffer is a ring of whole pages, PIPEPAGES of them
+// unless fcntl(F_SETPIPE_SZ) changes it. The page count is a power
+// of two, so nread and nwrite index the ring correctly even as
+// they wrap around.
+#define PIPEPAGES    4     // default, 16KB
+#define PIPEMAXPAGES 64    // 256KB
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[PIPEMAXPAGES];
+  uint size;      // bytes in the ring
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+// Where byte n of the stream lives, and how many bytes
+// from there on are in the same page.
+static char*
+pipebyte(struct pipe *pi, uint n, int *run)
+{
+  uint off = n % pi->size;
+
+  *run = PGSIZE - off % PGSIZE;
+  return pi->page[off / PGSIZE] + off % PGSIZE;
+}
+
+// Allocate npages pages into page[]. On failure free
+// the ones allocated and return -1.
+static int
+pipepages(char **page, int npages)
+{
+  int i;
+
+  for(i = 0; i < npages; i++){
+    if((page[i] = kalloc()) == 0){
+      while(--i >= 0)
+        kfree(page[i]);
+      return -1;
+    }
+  }
+  return 0;
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -30,6 +65,12 @@ pipealloc(struct file **f0, struct file **f1)
     goto bad;
   if((pi = (struct pipe*)kalloc()) == 0)
     goto bad;
+  if(pipepages(pi->page, PIPEPAGES) < 0){
+    kfree((char*)pi);
+    pi = 0;
+    goto bad;
+  }
+  pi->size = PIPEPAGES * PGSIZE;
   pi->readopen = 1;
   pi->writeopen = 1;
   pi->nwrite = 0;
@@ -68,15 +109,22 @@ pipeclose(struct pipe *pi, int writable)
   }
   if(pi->readopen == 0 && pi->writeopen == 0){
     release(&pi->lock);
+    for(int i = 0; i < pi->size / PGSIZE; i++)
+      kfree(pi->page[i]);
     kfree((char*)pi);
   } else
     release(&pi->lock);
 }
 
+// Copy as much of [addr, addr+n) as fits, a page of the ring
+// at a time. Readers only sleep on an empty pipe, so they are
+// woken when it stops being empty, or when a full pipe makes
+// us wait.
 int
 pipewrite(struct pipe *pi, uint64 addr, int n)
 {
-  int i = 0;
+  int i = 0, m;
+  char *p;
   struct proc *pr = myproc();
 
   acquire(&pi->lock);
@@ -85,46 +133,336 @@ pipewrite(struct pipe *pi, uint64 addr, int n)
       release(&pi->lock);
       return -1;
     }
-    if(pi->nwrite == pi->nread + PIPESIZE){ //DOC: pipewrite-full
+    if(pi->nwrite == pi->nread + pi->size){ //DOC: pipewrite-full
       wakeup(&pi->nread);
       sleep(&pi->nwrite, &pi->lock);
-    } else {
-      char ch;
-      if(copyin(pr->pagetable, &ch, addr + i, 1) == -1)
-        break;
-      pi->data[pi->nwrite++ % PIPESIZE] = ch;
-      i++;
+      continue;
     }
+    p = pipebyte(pi, pi->nwrite, &m);
+    if(m > n - i)
+      m = n - i;
+    if(m > pi->size - (pi->nwrite - pi->nread))
+      m = pi->size - (pi->nwrite - pi->nread);
+    if(copyin(pr->mm->pagetable, p, addr + i, m) == -1)
+      break;
+    if(pi->nwrite == pi->nread)
+      wakeup(&pi->nread);
+    pi->nwrite += m;
+    i += m;
   }
-  wakeup(&pi->nread);
   release(&pi->lock);
 
   return i;
 }
 
+// Sleep until pi holds data. Returns 1 if it does, 0 at end
+// of file, -1 if killed. Caller holds pi->lock.
+static int
+waitdata(struct pipe *pi)
+{
+  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
+    if(myproc()->killed)
+      return -1;
+    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+  }
+  return pi->nread != pi->nwrite;
+}
+
+// Sleep until pi has room. Returns -1 if the read end is
+// closed or we are killed. Caller holds pi->lock.
+static int
+waitroom(struct pipe *pi)
+{
+  while(pi->nwrite == pi->nread + pi->size && pi->readopen && !myproc()->killed){
+    wakeup(&pi->nread);
+    sleep(&pi->nwrite, &pi->lock);
+  }
+  if(pi->readopen == 0 || myproc()->killed)
+    return -1;
+  return 0;
+}
+
+// Writers only sleep on a full pipe, so wake them only if
+// this read made room in one.
 int
 piperead(struct pipe *pi, uint64 addr, int n)
 {
-  int i;
+  int i, m, wasfull;
+  char *p;
   struct proc *pr = myproc();
-  char ch;
 
   acquire(&pi->lock);
-  while(pi->nread == pi->nwrite && pi->writeopen){  //DOC: pipe-empty
-    if(pr->killed){
-      release(&pi->lock);
-      return -1;
-    }
-    sleep(&pi->nread, &pi->lock); //DOC: piperead-sleep
+  if(waitdata(pi) < 0){
+    release(&pi->lock);
+    return -1;
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(pi->nread == pi->nwrite)
+  wasfull = (pi->nwrite == pi->nread + pi->size);
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){  //DOC: piperead-copy
+    p = pipebyte(pi, pi->nread, &m);
+    if(m > n - i)
+      m = n - i;
+    if(m > pi->nwrite - pi->nread)
+      m = pi->nwrite - pi->nread;
+    if(copyout(pr->mm->pagetable, addr + i, p, m) == -1)
       break;
-    ch = pi->data[pi->nread++ % PIPESIZE];
-    if(copyout(pr->pagetable, addr + i, &ch, 1) == -1)
+    pi->nread += m;
+  }
+  if(wasfull && i > 0)
+    wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  release(&pi->lock);
+  return i;
+}
+
+// Append up to n bytes at src to pi, as many as fit.
+// Caller holds pi->lock. Returns the number appended.
+static int
+ringput(struct pipe *pi, char *src, int n)
+{
+  int i, m;
+  char *p;
+
+  for(i = 0; i < n && pi->nwrite != pi->nread + pi->size; i += m){
+    p = pipebyte(pi, pi->nwrite, &m);
+    if(m > n - i)
+      m = n - i;
+    if(m > pi->size - (pi->nwrite - pi->nread))
+      m = pi->size - (pi->nwrite - pi->nread);
+    memmove(p, src + i, m);
+    if(pi->nwrite == pi->nread)
+      wakeup(&pi->nread);
+    pi->nwrite += m;
+  }
+  return i;
+}
+
+// Move up to n bytes from in to out, as many as are in in and
+// fit in out. If keep is set, leave them in in too. Caller
+// holds both locks. Returns the number moved.
+static int
+ringmove(struct pipe *in, struct pipe *out, int n, int keep)
+{
+  int i, m, k, wasfull;
+  uint pos = in->nread;
+  char *p;
+
+  wasfull = (in->nwrite == in->nread + in->size);
+  for(i = 0; i < n && pos != in->nwrite; i += k, pos += k){
+    p = pipebyte(in, pos, &m);
+    if(m > n - i)
+      m = n - i;
+    if(m > in->nwrite - pos)
+      m = in->nwrite - pos;
+    if((k = ringput(out, p, m)) == 0)
       break;
   }
-  wakeup(&pi->nwrite);  //DOC: piperead-wakeup
+  if(!keep){
+    in->nread = pos;
+    if(wasfull && i > 0)
+      wakeup(&in->nwrite);
+  }
+  return i;
+}
+
+// Callbacks for readiblocks() and writeiblocks(), moving a
+// file block's bytes straight between the buffer cache and
+// the pipe's pages.
+static int
+pipeput(void *arg, char *src, int n)
+{
+  struct pipe *pi = arg;
+
+  acquire(&pi->lock);
+  n = ringput(pi, src, n);
+  release(&pi->lock);
+  return n;
+}
+
+static int
+pipetake(void *arg, char *dst, int n)
+{
+  struct pipe *pi = arg;
+  int i, m, wasfull;
+  char *p;
+
+  acquire(&pi->lock);
+  wasfull = (pi->nwrite == pi->nread + pi->size);
+  for(i = 0; i < n && pi->nread != pi->nwrite; i += m){
+    p = pipebyte(pi, pi->nread, &m);
+    if(m > n - i)
+      m = n - i;
+    if(m > pi->nwrite - pi->nread)
+      m = pi->nwrite - pi->nread;
+    memmove(dst + i, p, m);
+    pi->nread += m;
+  }
+  if(wasfull && i > 0)
+    wakeup(&pi->nwrite);
   release(&pi->lock);
   return i;
-}
\ No newline at end of file
+}
+
+// Read up to n bytes of ip at *off into pi, without passing
+// through user space. Waits for room first, like pipewrite(),
+// and again if another writer took it before we could copy.
+// Returns the number of bytes moved, 0 at end of file, or -1.
+int
+pipefromi(struct pipe *pi, struct inode *ip, uint *off, int n)
+{
+  int r, eof;
+
+  if(n == 0)
+    return 0;
+  for(;;){
+    acquire(&pi->lock);
+    r = waitroom(pi);
+    release(&pi->lock);
+    if(r < 0)
+      return -1;
+    ilock(ip);
+    if((r = readiblocks(ip, *off, n, pipeput, pi)) > 0)
+      *off += r;
+    eof = (*off >= ip->size);
+    iunlock(ip);
+    if(r > 0 || eof)
+      return r;
+    // another writer filled the pipe between the wait and the copy.
+  }
+}
+
+// Write up to n bytes from pi to ip at *off, without passing
+// through user space. Waits for data first, like piperead(),
+// and again if another reader took it before we could copy.
+// Returns the number of bytes moved, 0 at end of file, or -1.
+int
+pipetoi(struct pipe *pi, struct inode *ip, uint *off, int n)
+{
+  // a few blocks per transaction, as in filewrite().
+  int max = ((MAXOPBLOCKS-1-1-2) / 2) * BSIZE;
+  int i, n1, r;
+
+  if(n == 0)
+    return 0;
+  for(;;){
+    acquire(&pi->lock);
+    r = waitdata(pi);
+    release(&pi->lock);
+    if(r <= 0)
+      return r;
+    for(i = 0; i < n; i += r){
+      n1 = n - i < max ? n - i : max;
+      begin_op();
+      ilock(ip);
+      if((r = writeiblocks(ip, *off, n1, pipetake, pi)) > 0)
+        *off += r;
+      iunlock(ip);
+      end_op();
+      if(r < 0)
+        return i > 0 ? i : -1;
+      if(r < n1){
+        i += r;
+        break;
+      }
+    }
+    if(i > 0)
+      return i;
+    // another reader emptied the pipe between the wait and the copy.
+  }
+}
+
+// Move up to n bytes from in to out, waiting for data in in
+// and then for room in out. With keep set, in keeps its data;
+// that is tee(). Returns the number moved, 0 at end of file,
+// or -1.
+int
+pipemove(struct pipe *in, struct pipe *out, int n, int keep)
+{
+  struct pipe *a, *b;
+  int r;
+
+  if(in == out)
+    return -1;
+  if(n == 0)
+    return 0;
+  // take the two locks in address order
+  a = in < out ? in : out;
+  b = in < out ? out : in;
+  for(;;){
+    acquire(&in->lock);
+    r = waitdata(in);
+    release(&in->lock);
+    if(r <= 0)
+      return r;
+    acquire(&out->lock);
+    r = waitroom(out);
+    release(&out->lock);
+    if(r < 0)
+      return -1;
+    acquire(&a->lock);
+    acquire(&b->lock);
+    r = ringmove(in, out, n, keep);
+    release(&b->lock);
+    release(&a->lock);
+    if(r > 0)
+      return r;
+    // another reader or writer got there between the waits.
+  }
+}
+
+// Capacity of the pipe, in bytes.
+int
+pipegetsize(struct pipe *pi)
+{
+  return pi->size;
+}
+
+// Make the ring hold at least n bytes, rounded up to a power
+// of two pages. Fails if the data now in the pipe would not fit.
+// Returns the new size, or -1.
+int
+pipesetsize(struct pipe *pi, int n)
+{
+  char *page[PIPEMAXPAGES];
+  char *from, *to;
+  int npages, oldpages, i, m, run;
+  uint pos;
+
+  if(n <= 0 || n > PIPEMAXPAGES * PGSIZE)
+    return -1;
+  for(npages = 1; npages * PGSIZE < n; npages <<= 1)
+    ;
+  if(pipepages(page, npages) < 0)
+    return -1;
+
+  acquire(&pi->lock);
+  if(pi->nwrite - pi->nread > npages * PGSIZE){
+    release(&pi->lock);
+    for(i = 0; i < npages; i++)
+      kfree(page[i]);
+    return -1;
+  }
+  // move the bytes in the pipe to the same stream positions
+  // in the new ring, then swap the rings.
+  for(pos = pi->nread; pos != pi->nwrite; pos += m){
+    from = pipebyte(pi, pos, &m);
+    to = page[(pos % (npages * PGSIZE)) / PGSIZE] + pos % PGSIZE;
+    run = PGSIZE - pos % PGSIZE;  // both rings break pages at the same offsets
+    if(m > run)
+      m = run;
+    if(m > pi->nwrite - pos)
+      m = pi->nwrite - pos;
+    memmove(to, from, m);
+  }
+  oldpages = pi->size / PGSIZE;
+  for(i = 0; i < PIPEMAXPAGES; i++){
+    from = pi->page[i];
+    pi->page[i] = i < npages ? page[i] : 0;
+    page[i] = i < oldpages ? from : 0;
+  }
+  pi->size = npages * PGSIZE;
+  wakeup(&pi->nwrite);
+  release(&pi->lock);
+
+  for(i = 0; i < oldpages; i++)
+    kfree(page[i]);
+  return pi->size;
+}
@@ -11,6 +11,7 @@
 #include "memlayout.h"
 #include "loongarch.h"
 #include "defs.h"
+#include "list.h"
 #include "proc.h"
 
 volatile int panicked = 0;
@@ -47,6 +48,20 @@ printint(int xx, int base, int sign)
     consputc(buf[i]);
 }
 
+static void
+printlong(uint64 x)
+{
+  char buf[20];
+  int i = 0;
+
+  do {
+    buf[i++] = digits[x % 10];
+  } while((x /= 10) != 0);
+
+  while(--i >= 0)
+    consputc(buf[i]);
+}
+
 static void
 printptr(uint64 x)
 {
@@ -57,7 +72,8 @@ printptr(uint64 x)
     consputc(digits[x >> (sizeof(uint64) * 8 - 4)]);
 }
 
-// Print to the console. only understands %d, %x, %p, %s.
+// Print to the console. only understands %d, %x, %l, %p, %s.
+// %l is an unsigned 64-bit decimal.
 void
 printf(char *fmt, ...)
 {
@@ -88,6 +104,9 @@ printf(char *fmt, ...)
     case 'x':
       printint(va_arg(ap, int), 16, 1);
       break;
+    case 'l':
+      printlong(va_arg(ap, uint64));
+      break;
     case 'p':
       printptr(va_arg(ap, uint64));
       break;
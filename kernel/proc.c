@@ -3,57 +3,89 @@
 #include "memlayout.h"
 #include "loongarch.h"
 #include "spinlock.h"
+#include "list.h"
+#include "slab.h"
 #include "proc.h"
 #include "defs.h"
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// struct procs are allocated on demand from proc_cache,
+// up to NPROC of them at a time.
+struct kmem_cache proc_cache;
+
+// Address spaces, shared by a process and the threads
+// it clones, and freed with the last of them.
+struct kmem_cache mm_cache;
 
 struct proc *initproc;
 
+// pid_lock protects nextpid, nproc and the PID hash,
+// which holds every allocated proc so that kill() and
+// chpri() need not search. Acquire before any p->lock.
+#define NPIDHASH 64
 int nextpid = 1;
+int nproc = 0;
+struct list pidhash[NPIDHASH];
 struct spinlock pid_lock;
 
+// Sleeping processes, hashed by the channel they sleep on,
+// so that wakeup() only looks at processes that may match.
+// A queue's lock must be acquired before any p->lock.
+#define NSLEEPQ 64
+#define SLEEPQ(chan) (&sleepq[((uint64)(chan) >> 2) % NSLEEPQ])
+struct sleepq {
+  struct spinlock lock;
+  struct list head;
+} sleepq[NSLEEPQ];
+
+// Processes in sleepuntil(), which timerwake() wakes
+// once their deadlines pass. Acquired before any p->lock.
+struct {
+  struct spinlock lock;
+  struct list head;
+} timedq;
+
+// RUNNABLE processes, one FIFO per priority.
+// Acquired after p->lock.
+struct {
+  struct spinlock lock;
+  struct list queue[NPRIO];
+} runq;
+
 extern void forkret(void);
 static void freeproc(struct proc *p);
+static void tfunmap(struct proc *p);
+static void setexited(struct proc *p);
 
 // helps ensure that wakeups of wait()ing
 // parents are not lost. helps obey the
-// memory model when using p->parent.
+// memory model when using p->parent and
+// the children and threads lists.
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl) {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    if(mappages(kpgtbl, va, PGSIZE, (uint64)pa,  PTE_NX | PTE_P | PTE_W | PTE_MAT | PTE_D) != 0)
-      panic("kvmmap");
-  }
-}
-
 // initialize the proc table at boot time.
 void
 procinit(void)
 {
-  struct proc *p;
-  
+  int i;
+
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc)); 
+  initlock(&runq.lock, "runq");
+  initlock(&timedq.lock, "timedq");
+  list_init(&timedq.head);
+  for(i = 0; i < NPIDHASH; i++)
+    list_init(&pidhash[i]);
+  for(i = 0; i < NSLEEPQ; i++){
+    initlock(&sleepq[i].lock, "sleepq");
+    list_init(&sleepq[i].head);
   }
+  for(i = 0; i < NPRIO; i++)
+    list_init(&runq.queue[i]);
+  kmem_cache_init(&proc_cache, "proc", sizeof(struct proc));
+  kmem_cache_init(&mm_cache, "mm", sizeof(struct mm));
 }
 
 // Must be called with interrupts disabled,
@@ -85,67 +117,87 @@ myproc(void) {
   return p;
 }
 
-int
-allocpid() {
-  int pid;
-  
+// Give p a fresh pid and enter it in the PID hash.
+// Fails if NPROC processes already exist.
+static int
+allocpid(struct proc *p)
+{
   acquire(&pid_lock);
-  pid = nextpid;
+  if(nproc >= NPROC){
+    release(&pid_lock);
+    return -1;
+  }
+  nproc++;
+  p->pid = nextpid;
   nextpid = nextpid + 1;
+  list_add(&pidhash[(uint)p->pid % NPIDHASH], &p->pidlink);
   release(&pid_lock);
 
-  return pid;
+  return 0;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// Find the process with the given pid.
+// Caller must hold pid_lock.
 static struct proc*
-allocproc(void)
+findproc(int pid)
 {
+  struct list *head = &pidhash[(uint)pid % NPIDHASH];
+  struct list *e;
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
+  for(e = head->next; e != head; e = e->next){
+    p = list_entry(e, struct proc, pidlink);
+    if(p->pid == pid)
+      return p;
   }
   return 0;
+}
+
+// Allocate a proc from proc_cache and
+// initialize state required to run in the kernel,
+// and return with p->lock held.
+// If there are already NPROC procs, or a memory allocation fails, return 0.
+static struct proc*
+allocproc(void)
+{
+  struct proc *p;
+
+  if((p = kmem_cache_alloc(&proc_cache)) == 0)
+    return 0;
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
+  list_init(&p->children);
+  list_init(&p->zombies);
+  list_init(&p->threads);
+  list_init(&p->sibling);
+  list_init(&p->pidlink);
+  list_init(&p->sleeplink);
+  list_init(&p->runlink);
+  list_init(&p->timerlink);
 
-found:
-  p->pid = allocpid();
   p->state = USED;
   p->slot = SLOT;
+  p->nswitch = 0;
   p->priority = 10;
-  p->shm = TRAPFRAME -64 *2*PGSIZE;
-  p->shmkeymask = 0;
-  p->mqmask = 0;
+  p->cpumask = ALLCPUS;
+  memset(p->mqmask, 0, sizeof(p->mqmask));
   p->pthread = 0;
 
-  for (int i = 0; i < 10; i++)
-  {
-    p->vm[i].next = -1;
-    p->vm[i].length = 0;
+  // Allocate a kernel stack page; it is used through
+  // the direct-mapped window, like the trapframe.
+  if((p->kstack = (uint64)kalloc()) == 0){
+    freeproc(p);
+    return 0;
   }
-  p->vm[0].next = 0;
-  
 
   // Allocate a trapframe page.
   if((p->trapframe = (struct trapframe *)kalloc()) == 0){
     freeproc(p);
-    release(&p->lock);
     return 0;
   }
 
-  // An empty user page table.
-  p->pagetable = proc_pagetable(p);
-  if(p->pagetable == 0){
+  if(allocpid(p) < 0){
     freeproc(p);
-    release(&p->lock);
     return 0;
   }
 
@@ -155,33 +207,200 @@ found:
   p->context.ra = (uint64)forkret;
   p->context.sp = p->kstack + PGSIZE;
 
+  acquire(&p->lock);
   return p;
 }
 
 // free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
+// including its share of the address space, and return
+// it to proc_cache.
+// p->lock must not be held, and p must no longer be
+// on any list except the PID hash.
 static void
 freeproc(struct proc *p)
 {
+  if(p->tfva)
+    tfunmap(p);
+  if(p->mm)
+    mmput(p->mm);
+  p->mm = 0;
   if(p->trapframe)
     kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->pagetable)
-    proc_freepagetable(p->pagetable, p->sz);
-  p->pagetable = 0;
-  p->sz = 0;
-  p->pid = 0;
-  p->parent = 0;
-  p->name[0] = 0;
-  p->chan = 0;
-  p->killed = 0;
-  p->xstate = 0;
+  if(p->kstack)
+    kfree((void*)p->kstack);
+  p->kstack = 0;
+  if(p->pid){
+    acquire(&pid_lock);
+    list_del(&p->pidlink);
+    nproc--;
+    release(&pid_lock);
+  }
   p->state = UNUSED;
+  kmem_cache_free(&proc_cache, p);
+}
+
+// Mark p RUNNABLE and queue it for scheduler().
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  acquire(&runq.lock);
+  list_add_tail(&runq.queue[p->priority], &p->runlink);
+  release(&runq.lock);
+}
+
+// Take the most urgent RUNNABLE process whose cpumask
+// allows this cpu off the run queue.
+// Returns 0 if there is none.
+static struct proc*
+runq_pop(int cpu)
+{
+  struct list *e;
+  struct proc *p;
+
+  acquire(&runq.lock);
+  for(int i = 0; i < NPRIO; i++){
+    for(e = runq.queue[i].next; e != &runq.queue[i]; e = e->next){
+      p = list_entry(e, struct proc, runlink);
+      if(p->cpumask & (1U << cpu)){
+        list_del(e);
+        release(&runq.lock);
+        return p;
+      }
+    }
+  }
+  release(&runq.lock);
+  return 0;
+}
+
+// Allocate an address space with an empty page table,
+// referenced once. Returns 0 if out of memory.
+static struct mm*
+mmalloc(void)
+{
+  struct mm *mm;
+
+  if((mm = kmem_cache_alloc(&mm_cache)) == 0)
+    return 0;
+  memset(mm, 0, sizeof(*mm));
+  initlock(&mm->lock, "mm");
+  mm->refcount = 1;
+  mmclearvma(mm);
+  if((mm->pagetable = uvmcreate()) == 0){
+    kmem_cache_free(&mm_cache, mm);
+    return 0;
+  }
+  return mm;
+}
+
+// Drop a reference to mm, freeing its user memory and
+// page table with the last one. Every trapframe must
+// already be unmapped.
+void
+mmput(struct mm *mm)
+{
+  int last;
+
+  acquire(&mm->lock);
+  last = (--mm->refcount == 0);
+  release(&mm->lock);
+  if(!last)
+    return;
+  if(mm->tfslots)
+    panic("mmput: trapframe");
+  mmclearvma(mm);
+  uvmfree(mm->pagetable, mm->sz);
+  kmem_cache_free(&mm_cache, mm);
+}
+
+// Free every myalloc() region of mm, detach its shared
+// memory, and empty its vma list.
+void
+mmclearvma(struct mm *mm)
+{
+  struct vma *vm = mm->vm;
+
+  for(int i = vm[0].next; i != 0; i = vm[i].next){
+    if(vm[i].shm){
+      shmunmap(mm->pagetable, vm[i].address, vm[i].shm);
+      shmput(vm[i].shm);
+    } else {
+      mydeallocuvm(mm->pagetable, vm[i].address, vm[i].address + vm[i].length);
+    }
+  }
+  for(int i = 0; i < NVMA; i++){
+    vm[i].next = -1;
+    vm[i].length = 0;
+    vm[i].shm = 0;
+  }
+  vm[0].next = 0;
+}
+
+// Attach new to the shared memory old has attached, at the
+// same addresses. new has no regions yet. Caller holds
+// old->lock.
+static int
+vmacopyshm(struct mm *old, struct mm *new)
+{
+  int i, last = 0;
+
+  for(i = old->vm[0].next; i != 0; i = old->vm[i].next){
+    if(old->vm[i].shm == 0)
+      continue;
+    if(shmmap(new->pagetable, old->vm[i].address, old->vm[i].shm) < 0)
+      return -1;
+    shmdup(old->vm[i].shm);
+    new->vm[i] = old->vm[i];
+    new->vm[i].next = 0;
+    new->vm[last].next = i;
+    last = i;
+  }
+  return 0;
+}
+
+// Map p's trapframe into the lowest free slot of p->mm,
+// for uservec.S. Returns -1 if MAXTHREAD threads already
+// share the address space or out of memory.
+static int
+tfmap(struct proc *p)
+{
+  struct mm *mm = p->mm;
+  int i;
+
+  acquire(&mm->lock);
+  for(i = 0; i < MAXTHREAD; i++)
+    if((mm->tfslots & (1UL << i)) == 0)
+      break;
+  if(i == MAXTHREAD ||
+     mappages(mm->pagetable, TRAPFRAMESLOT(i), PGSIZE,
+              (uint64)(p->trapframe), PTE_NX | PTE_P | PTE_W | PTE_MAT | PTE_D) < 0){
+    release(&mm->lock);
+    return -1;
+  }
+  mm->tfslots |= 1UL << i;
+  release(&mm->lock);
+  p->tfva = TRAPFRAMESLOT(i);
+  return 0;
+}
+
+// Unmap p's trapframe and free its slot.
+static void
+tfunmap(struct proc *p)
+{
+  struct mm *mm = p->mm;
+
+  acquire(&mm->lock);
+  uvmunmap(mm->pagetable, p->tfva, 1, 0);
+  mm->tfslots &= ~(1UL << ((TRAPFRAME - p->tfva) / PGSIZE));
+  release(&mm->lock);
+  p->tfva = 0;
 }
 
 // Create a user page table for a given process,
-// with no user memory, but with kstack pages.
+// with no user memory, but with p's trapframe
+// mapped where it is in p->mm.
 
 pagetable_t
 proc_pagetable(struct proc *p)
@@ -193,8 +412,8 @@ proc_pagetable(struct proc *p)
   if(pagetable == 0)
     return 0;
 
-    // map the trapframe beneath 2 pages of KSTACK, for uservec.S.
-  if(mappages(pagetable, TRAPFRAME, PGSIZE,
+  // map the trapframe near the top of user memory, for uservec.S.
+  if(mappages(pagetable, p->tfva, PGSIZE,
               (uint64)(p->trapframe), PTE_NX | PTE_P | PTE_W | PTE_MAT | PTE_D) < 0){
     uvmfree(pagetable, 0);
     return 0;
@@ -203,12 +422,12 @@ proc_pagetable(struct proc *p)
   return pagetable;
 }
 
-// Free a process's page table, and free the
-// physical memory it refers to.
+// Free a page table made by proc_pagetable(), and free
+// the physical memory it refers to.
 void
-proc_freepagetable(pagetable_t pagetable, uint64 sz)
+proc_freepagetable(pagetable_t pagetable, uint64 tfva, uint64 sz)
 {
-  uvmunmap(pagetable, TRAPFRAME, 1, 0);
+  uvmunmap(pagetable, tfva, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -235,11 +454,13 @@ userinit(void)
 
   p = allocproc();
   initproc = p;
+  if((p->mm = mmalloc()) == 0 || tfmap(p) < 0)
+    panic("userinit");
   
   // allocate one user page and copy init's instructions
   // and data into it.
-  uvminit(p->pagetable, initcode, sizeof(initcode));
-  p->sz = PGSIZE;
+  uvminit(p->mm->pagetable, initcode, sizeof(initcode));
+  p->mm->sz = PGSIZE;
 
   // prepare for the very first "return" from kernel to user.
   p->trapframe->era = 0;      // user program counter
@@ -248,29 +469,38 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/"); 
 
-  p->state = RUNNABLE;
+  setrunnable(p);
 
   release(&p->lock);
 }
 
-// Grow or shrink user memory by n bytes.
-// Return 0 on success, -1 on failure.
+// Grow or shrink user memory by n bytes, and set *oldsz
+// to the size before. Return 0 on success, -1 on failure.
+// The size is shared by every thread of the process.
 int
-growproc(int n)
+growproc(int n, int *oldsz)
 {
   uint sz;
-  struct proc *p = myproc();
+  struct mm *mm = myproc()->mm;
 
-  sz = p->sz;
+  acquire(&mm->lock);
+  sz = mm->sz;
+  *oldsz = sz;
   if(n > 0){
-    if(sz+n>=MAXVA-PGSIZE)return -1;//trampoline
-    if((sz = uvmalloc(p->pagetable, sz, sz + n)) == 0) {
+    if(sz+n > VMATOP ||   // trapframes
+       (mm->vm[0].next != 0 && sz+n > mm->vm[mm->vm[0].next].address)){   // myalloc() regions, shm
+      release(&mm->lock);
+      return -1;
+    }
+    if((sz = uvmalloc(mm->pagetable, sz, sz + n)) == 0) {
+      release(&mm->lock);
       return -1;
     }
   } else if(n < 0){
-    sz = uvmdealloc(p->pagetable, sz, sz + n);
+    sz = uvmdealloc(mm->pagetable, sz, sz + n);
   }
-  p->sz = sz;
+  mm->sz = sz;
+  release(&mm->lock);
   return 0;
 }
 
@@ -289,24 +519,29 @@ fork(void)
   }
 
   // Copy user memory from parent to child.
-  if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
+  // The child gets an address space of its own,
+  // with only the first trapframe slot in use.
+  if((np->mm = mmalloc()) == 0 || tfmap(np) < 0){
+    release(&np->lock);
     freeproc(np);
+    return -1;
+  }
+  acquire(&p->mm->lock);
+  if(uvmcopy(p->mm->pagetable, np->mm->pagetable, p->mm->sz) < 0){
+    release(&p->mm->lock);
     release(&np->lock);
+    freeproc(np);
     return -1;
   }
-  np->sz = p->sz;
-  //  Copy shared memory
-  shmaddcount(p->shmkeymask);
-  np->shm = p->shm;
-  np->shmkeymask = p->shmkeymask;
-
-  for(i = 0;i < 8;++i)
-  {
-    if(shmkeyused(i,np->shmkeymask))
-    {
-      np->shmva[i] = p->shmva[i];
-    }
+  np->mm->sz = p->mm->sz;
+  if(vmacopyshm(p->mm, np->mm) < 0){
+    release(&p->mm->lock);
+    release(&np->lock);
+    freeproc(np);
+    return -1;
   }
+  release(&p->mm->lock);
+  np->cpumask = p->cpumask;
 
   // copy saved user registers.
   *(np->trapframe) = *(p->trapframe);
@@ -315,7 +550,7 @@ fork(void)
   np->trapframe->a0 = 0;
 
   addmqcount(p->mqmask);
-  np->mqmask = p->mqmask;
+  memmove(np->mqmask, p->mqmask, sizeof(p->mqmask));
 
   // increment reference counts on open file descriptors.
   for(i = 0; i < NOFILE; i++)
@@ -331,27 +566,76 @@ fork(void)
 
   acquire(&wait_lock);
   np->parent = p;
+  list_add_tail(&p->children, &np->sibling);
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
 }
 
+// Hand every process on list l to init.
+static void
+giveinit(struct list *l)
+{
+  struct list *e;
+
+  for(e = l->next; e != l; e = e->next)
+    list_entry(e, struct proc, sibling)->parent = initproc;
+}
+
 // Pass p's abandoned children to init.
+// Touches only p's own children, live or zombie.
 // Caller must hold wait_lock.
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
+  if(!list_empty(&p->children) || !list_empty(&p->zombies)){
+    giveinit(&p->children);
+    giveinit(&p->zombies);
+    list_splice_tail(&initproc->children, &p->children);
+    list_splice_tail(&initproc->zombies, &p->zombies);
+    wakeup(initproc);
+  }
+}
+
+// Kill the threads p has cloned and wait until they
+// have all exited, reaping them as they go, so that
+// none is left running in an address space whose
+// owner is gone.
+// Caller must hold wait_lock.
+static void
+exitthreads(struct proc *p)
+{
+  struct list *e, *next;
+  struct proc *t;
+
+  for(e = p->threads.next; e != &p->threads; e = e->next){
+    t = list_entry(e, struct proc, sibling);
+    acquire(&t->lock);
+    t->killed = 1;
+    if(t->state == SLEEPING)
+      setrunnable(t);
+    release(&t->lock);
+  }
 
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
+  while(!list_empty(&p->threads)){
+    for(e = p->threads.next; e != &p->threads; e = next){
+      next = e->next;
+      t = list_entry(e, struct proc, sibling);
+      acquire(&t->lock);
+      if(t->state == ZOMBIE){
+        release(&t->lock);
+        list_del(&t->sibling);
+        freeproc(t);
+      } else {
+        release(&t->lock);
+      }
     }
+    if(!list_empty(&p->threads))
+      sleep(p, &wait_lock);
   }
 }
 
@@ -382,14 +666,28 @@ exit(int status)
 
   acquire(&wait_lock);
 
+  // Take the rest of the thread group down first.
+  exitthreads(p);
+
   // Give any children to init.
   reparent(p);
 
   // Parent might be sleeping in wait().
-  if(p->parent==0 && p->pthread!=0)
+  if(p->parent==0 && p->pthread!=0){
+    if(p->detached){
+      // nobody will join us: leave the group now, and
+      // scheduler() frees us once we are off our stack.
+      list_del(&p->sibling);
+      setexited(p);
+    }
+    // joiners, and an exiting leader, sleep on the leader.
     wakeup(p->pthread);
-  else
+  } else if(p->parent){
+    // Move to the parent's zombie list so wait() finds us directly.
+    list_del(&p->sibling);
+    list_add_tail(&p->parent->zombies, &p->sibling);
     wakeup(p->parent);
+  }
   
   acquire(&p->lock);
 
@@ -409,45 +707,40 @@ int
 wait(uint64 addr)
 {
   struct proc *np;
-  int havekids, pid;
+  int pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
-    havekids = 0;
-    for(np = proc; np < &proc[NPROC]; np++){
-      if(np->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&np->lock);
-
-        havekids = 1;
-        if(np->state == ZOMBIE){
-          // Found one.
-          pid = np->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&np->xstate,
-                                  sizeof(np->xstate)) < 0) {
-            release(&np->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          shmrelease(np->pagetable,np->shm,np->shmkeymask);
-          np->shm = TRAPFRAME - 64*2*PGSIZE;
-          np->shmkeymask = 0;
-          releasemq2(np->mqmask);
-          np->mqmask = 0;
-          freeproc(np);
-          release(&np->lock);
-          release(&wait_lock);
-          return pid;
-        }
+    // exit() queues exited children on p->zombies,
+    // so there is nothing to search for.
+    if(!list_empty(&p->zombies)){
+      np = list_entry(p->zombies.next, struct proc, sibling);
+
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&np->lock);
+      if(np->state != ZOMBIE)
+        panic("wait: not zombie");
+
+      pid = np->pid;
+      if(addr != 0 && copyout(p->mm->pagetable, addr, (char *)&np->xstate,
+                              sizeof(np->xstate)) < 0) {
         release(&np->lock);
+        release(&wait_lock);
+        return -1;
       }
+      release(&np->lock);
+      list_del(&np->sibling);
+      releasemq2(np->mqmask);
+      memset(np->mqmask, 0, sizeof(np->mqmask));
+      freeproc(np);
+      release(&wait_lock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || p->killed){
+    if(list_empty(&p->children) || p->killed){
       release(&wait_lock);
       return -1;
     }
@@ -468,48 +761,39 @@ void
 scheduler(void)
 {
   struct proc *p;
-  struct proc *temp;
   struct cpu *c = mycpu();
-  int priority;
-  int needed = 1;
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      if(needed)
-      {
-        priority = 19;
-        for(temp = proc;temp < &proc[NPROC];temp++)
-        {
-          if(temp->state == RUNNABLE && temp->priority < priority)
-            priority = temp->priority;
-        }
-      }
-      needed = 0;
-      if(p->state != RUNNABLE)
-        continue;
-      if(p->priority > priority)
-        continue;
+    // The run queue hands out the most urgent process this
+    // cpu may run, round-robin among equal priorities.
+    if((p = runq_pop(cpuid())) == 0)
+      continue;
 
-      acquire(&p->lock);
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        p->state = RUNNING;
-        c->proc = p;
-        swtch(&c->context, &p->context);
-
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      c->proc = p;
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      c->proc = 0;
+
+      if(p->state == ZOMBIE && p->detached){
+        // an exited detached thread, which nobody will join.
+        release(&p->lock);
+        freeproc(p);
+        continue;
       }
-      release(&p->lock);
-      needed = 1;
     }
+    release(&p->lock);
   }
 }
 
@@ -536,6 +820,7 @@ sched(void)
     panic("sched interruptible");
 
   intena = mycpu()->intena;
+  p->nswitch++;
   swtch(&p->context, &mycpu()->context);
   mycpu()->intena = intena;
 }
@@ -546,7 +831,7 @@ yield(void)
 {
   struct proc *p = myproc();
   acquire(&p->lock);
-  p->state = RUNNABLE;
+  setrunnable(p);
   sched();
   release(&p->lock);
 }
@@ -579,67 +864,126 @@ void
 sleep(void *chan, struct spinlock *lk)
 {
   struct proc *p = myproc();
-  
+  struct sleepq *q = SLEEPQ(chan);
+
+#ifdef LOCKDEP
+  lockdep_sleep(lk);
+#endif
   // Must acquire p->lock in order to
   // change p->state and then call sched.
-  // Once we hold p->lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
-  // so it's okay to release lk.
+  // Once we hold the sleep queue lock and p->lock,
+  // we can be guaranteed that we won't miss any wakeup
+  // (wakeup locks both), so it's okay to release lk.
 
+  acquire(&q->lock);
   acquire(&p->lock);  //DOC: sleeplock1
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  list_add_tail(&q->head, &p->sleeplink);
+  release(&q->lock);
 
   sched();
 
   // Tidy up.
   p->chan = 0;
+  release(&p->lock);
+
+  // kill() makes sleepers runnable without
+  // taking them off their sleep queue.
+  acquire(&q->lock);
+  list_del(&p->sleeplink);
+  release(&q->lock);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
 }
 
-// Wake up all processes sleeping on chan.
-// Must be called without any p->lock.
+// Like sleep(), but also wake up by the tick deadline.
+// Wakeups may come early or, rarely, one tick late;
+// the caller checks the time itself.
 void
-wakeup(void *chan)
+sleepuntil(void *chan, struct spinlock *lk, uint deadline)
+{
+  struct proc *p = myproc();
+
+  acquire(&timedq.lock);
+  p->wakeat = deadline;
+  list_add_tail(&timedq.head, &p->timerlink);
+  release(&timedq.lock);
+
+  sleep(chan, lk);
+
+  acquire(&timedq.lock);
+  list_del(&p->timerlink);
+  release(&timedq.lock);
+}
+
+// Called at every clock tick. A process whose deadline passes
+// on its way into sleep() is not SLEEPING yet, but stays on
+// timedq and is woken at the next tick.
+void
+timerwake(uint now)
+{
+  struct list *e;
+  struct proc *p;
+
+  acquire(&timedq.lock);
+  for(e = timedq.head.next; e != &timedq.head; e = e->next){
+    p = list_entry(e, struct proc, timerlink);
+    if((int)(now - p->wakeat) < 0)
+      continue;
+    acquire(&p->lock);
+    if(p->state == SLEEPING)
+      setrunnable(p);
+    release(&p->lock);
+  }
+  release(&timedq.lock);
+}
+
+// Wake up processes sleeping on chan, all of them
+// or, if one is set, only the longest sleeper.
+// Must be called without any p->lock.
+static void
+wakeupn(void *chan, int one)
 {
+  struct sleepq *q = SLEEPQ(chan);
+  struct list *e, *next;
   struct proc *p;
+  int woken = 0;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
+  acquire(&q->lock);
+  for(e = q->head.next; e != &q->head && !woken; e = next){
+    next = e->next;
+    p = list_entry(e, struct proc, sleeplink);
     if(p != myproc()){
       acquire(&p->lock);
       if(p->state == SLEEPING && p->chan == chan) {
-        p->state = RUNNABLE;
+        list_del(&p->sleeplink);
+        setrunnable(p);
+        woken = one;
       }
       release(&p->lock);
     }
   }
+  release(&q->lock);
 }
 
+// Wake up all processes sleeping on chan.
+// Must be called without any p->lock.
+void
+wakeup(void *chan)
+{
+  wakeupn(chan, 0);
+}
+
+// Wake up the process that has slept longest on chan.
 void 
 wakeup1p(void *chan) 
 {
-  struct proc *p;
- 
-  for (p = proc; p < &proc[NPROC]; p++)
-  {
-    if(p != myproc()) {
-      acquire(&p->lock);
-    if(p->state == SLEEPING && p->chan == chan) {
-      p->state = RUNNABLE;
-      release(&p->lock);
-      break;
-    }
-    release(&p->lock);
-    }
-  }
-   
+  wakeupn(chan, 1);
 }
 
 // Kill the process with the given pid.
@@ -650,20 +994,20 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  acquire(&pid_lock);
+  if((p = findproc(pid)) == 0){
+    release(&pid_lock);
+    return -1;
+  }
+  acquire(&p->lock);
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
   }
-  return -1;
+  release(&p->lock);
+  release(&pid_lock);
+  return 0;
 }
 
 // Copy to either a user address, or kernel address,
@@ -674,7 +1018,7 @@ either_copyout(int user_dst, uint64 dst, void *src, uint64 len)  //todo
 {
   struct proc *p = myproc();
   if(user_dst){
-    return copyout(p->pagetable, dst, src, len);
+    return copyout(p->mm->pagetable, dst, src, len);
   } else {
     memmove((char *)dst, src, len);
     return 0;
@@ -689,7 +1033,7 @@ either_copyin(void *dst, int user_src, uint64 src, uint64 len)  //todo
 {
   struct proc *p = myproc();
   if(user_src){
-    return copyin(p->pagetable, dst, src, len);
+    return copyin(p->mm->pagetable, dst, src, len);
   } else {
     memmove(dst, (char*)src, len);
     return 0;
@@ -710,76 +1054,145 @@ procdump(void)
   [ZOMBIE]    "zombie"
   };
   struct proc *p;
+  struct list *e;
   char *state;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
-    if(p->state == UNUSED)
-      continue;
-    if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
-    else
-      state = "???";
-    printf("time slice:%d t,pid=%d,state=%s,priority=%d %s", p->slot,p->pid, 
-    state, p->priority,p->name);
-    printf("\n");
-
-    for (int i = p->vm[0].next; i != 0; i = p->vm[i].next)
-    {
-      printf("start: %d, length: %d \n",p->vm[i].address, p->vm[i].length);
-    }
-    printf("\n");
+  for(int h = 0; h < NPIDHASH; h++){
+    for(e = pidhash[h].next; e != &pidhash[h]; e = e->next){
+      p = list_entry(e, struct proc, pidlink);
+      if(p->state == UNUSED)
+        continue;
+      if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
+        state = states[p->state];
+      else
+        state = "???";
+      printf("time slice:%d t,pid=%d,state=%s,priority=%d %s", p->slot,p->pid, 
+      state, p->priority,p->name);
+      printf("\n");
+
+      if(p->mm && p->pthread == 0){
+        for (int i = p->mm->vm[0].next; i != 0; i = p->mm->vm[i].next)
+        {
+          printf("start: %d, length: %d \n",p->mm->vm[i].address, p->mm->vm[i].length);
+        }
+      }
+      printf("\n");
     
+    }
   }
 }
 
+// Set the scheduling priority of process pid.
+// Returns pid, or -1 if there is no such process
+// or priority is out of range.
 uint64
 chpri(int pid,int priority)
 {
   struct proc *p;
-  for(p = proc;p < &proc[NPROC];p++)
-  {
-    acquire(&p->lock);
-    if(p->pid == pid)
-    {
-      p->priority = priority;
-      release(&p->lock);
-      break;
-    }
-    release(&p->lock);
 
+  if(priority < 0 || priority >= NPRIO)
+    return -1;
+  acquire(&pid_lock);
+  if((p = findproc(pid)) == 0){
+    release(&pid_lock);
+    return -1;
+  }
+  acquire(&p->lock);
+  p->priority = priority;
+  acquire(&runq.lock);
+  if(!list_empty(&p->runlink)){
+    // already queued: move to the new priority's queue.
+    list_del(&p->runlink);
+    list_add_tail(&runq.queue[priority], &p->runlink);
   }
+  release(&runq.lock);
+  release(&p->lock);
+  release(&pid_lock);
   return (uint64)pid;
 }
 
+// Restrict process pid (0 means the caller) to the CPUs
+// in mask. Returns 0, or -1 if there is no such process
+// or mask names no CPU that exists.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+  int self;
+
+  mask &= ALLCPUS;
+  if(mask == 0)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+
+  acquire(&pid_lock);
+  if((p = findproc(pid)) == 0){
+    release(&pid_lock);
+    return -1;
+  }
+  self = (p == myproc());
+  acquire(&p->lock);
+  acquire(&runq.lock);
+  p->cpumask = mask;
+  release(&runq.lock);
+  release(&p->lock);
+  release(&pid_lock);
+
+  // migrate now if this cpu is no longer allowed.
+  if(self && (mask & (1U << getcpuid())) == 0)
+    yield();
+  return 0;
+}
+
+// Return the cpumask of process pid (0 means the caller),
+// or -1 if there is no such process.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if(pid == 0)
+    pid = myproc()->pid;
+  acquire(&pid_lock);
+  if((p = findproc(pid)) == 0){
+    release(&pid_lock);
+    return -1;
+  }
+  acquire(&p->lock);
+  mask = p->cpumask;
+  release(&p->lock);
+  release(&pid_lock);
+  return mask;
+}
+
 //调用clone()前需要分配好线程栈的内存空间，并通过stack参数传入
-int clone(void (*fcn)(void *), void *stack, void *arg) {
+//tls 是新线程的线程指针, 装入 tp 寄存器
+int clone(void (*fcn)(void *), void *stack, void *arg, void *tls) {
 
   struct proc *curproc = myproc();    //记录发出clone的进程
   struct proc *np;
   if ((np = allocproc()) == 0)        //为新线程分配PCB/TCB
     return -1;
  
-   np->pagetable = curproc->pagetable;   //线程间共用同一个页表
- 
-   if((np->trapframe = (struct trapframe *)kalloc()) == 0){    //分配线程内核栈空间
-     freeproc(np);
-     release(&np->lock);
-     return 0;
-   }
+   // 线程间共用同一个地址空间, sz 和 vma 也随之共享
+   np->mm = curproc->mm;
+   acquire(&np->mm->lock);
+   np->mm->refcount++;
+   release(&np->mm->lock);
  
-   
-   np->sz = curproc->sz;
-   np->pthread = curproc;          // exit时用于找到父线程并唤醒
+   np->cpumask = curproc->cpumask;
    np->ustack = stack;             // 设置自己的线程栈
    np->parent = 0;
    *(np->trapframe) = *(curproc->trapframe);   //继承trapframe
  
-   // 设置trapframe映射
-   if(mappages(np->pagetable, TRAPFRAME - PGSIZE, PGSIZE,
-               (uint64)(np->trapframe), PTE_NX | PTE_P | PTE_W | PTE_MAT | PTE_D) < 0){  
-    uvmfree(np->pagetable, 0);
-    return 0;
+   // 在空闲的槽位映射自己的trapframe
+   if(tfmap(np) < 0){
+    release(&np->lock);
+    freeproc(np);
+    return -1;
   }
   // 设置栈指针
   // np->trapframe->sp = (e)(stack + 4096 -8);
@@ -790,6 +1203,9 @@ int clone(void (*fcn)(void *), void *stack, void *arg) {
   // 修改返回地址
   np->trapframe->era = (uint64)fcn;
 
+  // 线程局部存储
+  np->trapframe->tp = (uint64)tls;
+
   // 复制文件描述符
   for (int i = 0; i < NOFILE; i++)
     if (curproc->ofile[i])
@@ -801,104 +1217,256 @@ int clone(void (*fcn)(void *), void *stack, void *arg) {
 
   release(&np->lock);
 
+  // 线程组是扁平的: 线程创建的线程也属于主线程,
+  // 由主线程 join, 主线程退出时一并结束
+  acquire(&wait_lock);
+  if(curproc->pthread)
+    curproc = curproc->pthread;
+  np->pthread = curproc;          // exit时用于找到父线程并唤醒
+  list_add_tail(&curproc->threads, &np->sibling);
+  release(&wait_lock);
+
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  setrunnable(np);
   release(&np->lock);
 
   // 返回新线程的pid
   return pid;
 }
 
-int join() {
-struct proc *curproc = myproc();
+// Free zombie thread p, copying its exit status to user
+// address addr if it is not 0. Returns p's tid, or -1.
+// Caller must hold wait_lock.
+static int
+reapthread(struct proc *p, uint64 addr)
+{
+  int tid = p->pid;
+
+  if(addr != 0 && copyout(myproc()->mm->pagetable, addr, (char *)&p->xstate,
+                          sizeof(p->xstate)) < 0)
+    return -1;
+  list_del(&p->sibling);
+  freeproc(p);
+  return tid;
+}
+
+// Find thread tid of the caller's group that can still be
+// joined. Caller must hold wait_lock, which keeps such a
+// thread from being freed.
+static struct proc*
+findthread(int tid)
+{
+  struct proc *leader = myproc()->pthread ? myproc()->pthread : myproc();
   struct proc *p;
-  int havekids;
+
+  acquire(&pid_lock);
+  p = findproc(tid);
+  if(p && (p->pthread != leader || p->detached))
+    p = 0;
+  release(&pid_lock);
+  return p;
+}
+
+// Tell a detached thread's creator that its stack is free.
+// Caller must hold wait_lock.
+static void
+setexited(struct proc *p)
+{
+  int one = 1;
+
+  if(p->exitaddr == 0)
+    return;
+  if(copyout(p->mm->pagetable, p->exitaddr, (char *)&one, sizeof(one)) == 0)
+    futex_wake(p->exitaddr, MAXTHREAD);
+}
+
+// Wait for thread tid of the caller's group to exit, or for
+// any of them if tid is 0, and copy its exit status to addr.
+// Returns the tid, or -1 if there is no such thread.
+int
+join(int tid, uint64 addr)
+{
+  struct proc *curproc = myproc();
+  struct proc *leader, *p;
+  struct list *e;
+  int r, joinable;
+
+  acquire(&wait_lock);
+  leader = curproc->pthread ? curproc->pthread : curproc;
   for (;;) {
-    havekids = 0;
-    for (p = proc; p < &proc[NPROC]; p++) {
-      if (p->pthread != curproc)    // 判断是不是自己的子线程
-        continue;
- 
-      havekids = 1;
+    if (tid != 0) {
+      if ((p = findthread(tid)) == 0 || p == curproc) {
+        release(&wait_lock);
+        return -1;
+      }
+      acquire(&p->lock);
       if (p->state == ZOMBIE) {
+        release(&p->lock);
+        r = reapthread(p, addr);
+        release(&wait_lock);
+        return r;
+      }
+      release(&p->lock);
+    } else {
+      // the caller is on this list too unless it is the leader,
+      // and detached threads are never joined.
+      joinable = 0;
+      for (e = leader->threads.next; e != &leader->threads; e = e->next) {
+        p = list_entry(e, struct proc, sibling);
+        if (p == curproc || p->detached)
+          continue;
+        joinable = 1;
         acquire(&p->lock);
-        if(p->trapframe)
-          kfree((void*)p->trapframe);
-        p->trapframe = 0;
-        if(p->pagetable)
-          uvmunmap(p->pagetable, TRAPFRAME - PGSIZE, 1, 0); // 释放内核栈
-        p->pagetable = 0;
-        p->sz = 0;
-        p->pid = 0;
-        p->parent = 0;
-        p->pthread = 0;
-        p->name[0] = 0;
-        p->chan = 0;
-        p->killed = 0;
-        p->xstate = 0;
-        p->state = UNUSED;
-
-        int pid = p->pid;
-
+        if (p->state == ZOMBIE) {
+          release(&p->lock);
+          r = reapthread(p, addr);
+          release(&wait_lock);
+          return r;
+        }
         release(&p->lock);
-        return pid;
+      }
+      if (!joinable) {
+        release(&wait_lock);
+        return -1;
       }
     }
-    if (!havekids || curproc->killed) {
+    if (curproc->killed) {
+      release(&wait_lock);
       return -1;
     }
-    sleep(curproc, &wait_lock);
+    sleep(leader, &wait_lock);
+  }
+}
+
+// Let thread tid of the caller's group be freed when it
+// exits instead of joined. If addr is not 0, the word there
+// is set to 1, and futex waiters on it woken, once the thread
+// no longer uses its user stack. Returns 0, or -1.
+int
+detach(int tid, uint64 addr)
+{
+  struct proc *p;
+
+  acquire(&wait_lock);
+  if ((p = findthread(tid)) == 0) {
+    release(&wait_lock);
+    return -1;
+  }
+  // under p->lock too, which scheduler() holds when it checks
+  // detached on a thread that just became a ZOMBIE.
+  acquire(&p->lock);
+  p->detached = 1;
+  p->exitaddr = addr;
+  if (p->state == ZOMBIE) {
+    // exited already, so free it here.
+    release(&p->lock);
+    setexited(p);
+    reapthread(p, 0);
+  } else {
+    release(&p->lock);
+  }
+  release(&wait_lock);
+  return 0;
+}
+
+// 在 mm 中为 n 字节登记一块内存，不做映射。块按 align 对齐，
+// 放在从 VMATOP 往下第一个放得下的空隙，堆从下往上长，二者
+// 不相撞。shm 是要映射的共享内存对象，myalloc() 的块为 0。
+// 调用者持有 mm->lock。返回起始地址，没有空间或空闲记录时返回 0。
+uint64
+vmareserve(struct mm *mm, int n, uint64 align, struct shmobj *shm)
+{
+  struct vma *vm = mm->vm;     // 遍历寻找合适的空间
+  uint64 lo, hi, a, start = 0;
+  int index;
+  int prev = 0, at = -1;
+  int i;
+
+  if(n <= 0)
+    return 0;
+  lo = PGROUNDUP(mm->sz);
+  for(index = vm[0].next; ; index = vm[index].next){   // 按地址从低到高看每个空隙
+    hi = index != 0 ? vm[index].address : VMATOP;
+    if(hi >= lo + n && (a = (hi - n) & ~(align - 1)) >= lo){
+      start = a;             // 记下最高的一个
+      at = prev;
+    }
+    if(index == 0)
+      break;
+    lo = PGROUNDUP(vm[index].address + vm[index].length);
+    prev = index;
+  }
+  if(at < 0)
+    return 0;
+
+  for(i = 1; i < NVMA; i++) {            // 寻找一块没有用的 vma 记录新的内存块
+    if(vm[i].next == -1){
+      vm[i].next = vm[at].next;
+      vm[i].address = start;
+      vm[i].length = n;
+      vm[i].shm = shm;
+      vm[at].next = i;              //将vm[i]按地址顺序挂入链表
+      return start;
+    }
   }
   return 0;
 }
 
+// address 开头的内存块，没有时返回 0。调用者持有 mm->lock。
+struct vma*
+vmalookup(struct mm *mm, uint64 address)
+{
+  struct vma *vm = mm->vm;
+
+  for(int index = vm[0].next; index != 0; index = vm[index].next)
+    if(vm[index].address == address && vm[index].length > 0)
+      return &vm[index];
+  return 0;
+}
+
+// 注销 address 开头的内存块，不解除映射。调用者持有 mm->lock。
+void
+vmaremove(struct mm *mm, uint64 address)
+{
+  struct vma *vm = mm->vm;
+  int prev = 0;
+  int index;
+
+  for(index = vm[0].next; index != 0; index = vm[index].next) {
+    if(vm[index].address == address && vm[index].length > 0) {    //找到对应内存块
+      vm[prev].next = vm[index].next;     //从链上摘除
+      vm[index].next = -1;        //标记为未用
+      vm[index].length = 0;
+      vm[index].shm = 0;
+      return;
+    }
+    prev = index;
+  }
+}
+
 uint64 
 mygrowproc(int n){                 // 实现首次最佳适应算法
-	struct proc *proc = myproc();
-  struct vma *vm = proc->vm;     // 遍历寻找合适的空间
-	uint64 start = proc->sz;          // 寻找合适的分配起点
-	int index;
-	int prev = 0;
-	int i;
-
- 	for(index = vm[0].next; index != 0; index = vm[index].next){
- 		if(start + n < vm[index].address)
-		break;
- 		start = vm[index].address + vm[index].length;
- 		prev = index;
- 	}
- 	
- 	for(i = 1; i < 10; i++) {            // 寻找一块没有用的 vma 记录新的内存块
- 		if(vm[i].next == -1){
- 			vm[i].next = index;			
- 			vm[i].address = start;
- 			vm[i].length = n;
- 
- 			vm[prev].next = i;              //将vm[i]挂入链表尾部
- 			
- 			myallocuvm(proc->pagetable, start, start + n);    //为vm[i]分配内存
- 			return start;   // 返回分配的地址
- 		}
- 	}
- 	return 0;
+  struct mm *mm = myproc()->mm;     // 各线程共享的地址空间
+  uint64 start;
+
+  acquire(&mm->lock);
+  if((start = vmareserve(mm, n, PGSIZE, 0)) != 0)
+    myallocuvm(mm->pagetable, start, start + n);    //为这一块分配内存
+  release(&mm->lock);
+  return start;   // 返回分配的地址
 }
 
 int
 myreduceproc(uint64 address){  // 释放 address 开头的内存块
- 	int prev = 0;
- 	int index;
-  struct proc *proc = myproc();
- 
- 	for(index = proc->vm[0].next; index != 0; index = proc->vm[index].next) {
- 		if(proc->vm[index].address == address && proc->vm[index].length > 0) {    //找到对应内存块
- 			mydeallocuvm(proc->pagetable, proc->vm[index].address, proc->vm[index].address + proc->vm[index].length);		  //释放内存	
- 			proc->vm[prev].next = proc->vm[index].next;     //从链上摘除
- 			proc->vm[index].next = -1;        //标记为未用
- 			proc->vm[index].length = 0;
- 			break;
- 		}
- 		prev = index;
- 	}
+  struct mm *mm = myproc()->mm;
+  struct vma *v;
+
+  acquire(&mm->lock);
+  if((v = vmalookup(mm, address)) != 0 && v->shm == 0){   // 共享内存用 shmdt() 解除
+    mydeallocuvm(mm->pagetable, address, address + v->length);		  //释放内存
+    vmaremove(mm, address);
+  }
+  release(&mm->lock);
   return 0;
 }
 
@@ -67,10 +67,24 @@ struct trapframe {
 
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+struct shmobj;
+
 struct vma{
   uint64 address;   // 内存块起始地址
   int length;  // 内存块大小
   int next;    // 下一块内存索引，-1 表示未分配，0 表示没有下一个
+  struct shmobj *shm;   // 映射的共享内存对象，myalloc() 的内存块为 0
+};
+
+// An address space, shared by a process and the threads it clones.
+struct mm
+{
+  struct spinlock lock;        // protects everything below
+  int refcount;                // threads using this address space
+  pagetable_t pagetable;       // User lower half address page table
+  uint64 sz;                   // Size of process memory (bytes)
+  uint64 tfslots;              // bit i: a trapframe is mapped at TRAPFRAME - i*PGSIZE
+  struct vma vm[NVMA];         // myalloc() regions and shm, by address
 };
 
 struct proc
@@ -84,28 +98,40 @@ struct proc
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
 
-  // wait_lock must be held when using this:
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
   struct proc *pthread;       //Parent thread
+  struct list children;        // Live processes forked by this one
+  struct list zombies;         // Exited children waiting to be reaped
+  struct list threads;         // Threads cloned by this one
+  struct list sibling;         // On parent's children or zombies, or pthread->threads
   void *ustack;               //User thread stack
+  int detached;                // Thread is freed at exit, not joined
+  uint64 exitaddr;             // Detached thread: user word set to 1 at exit
+
+  struct list pidlink;         // PID hash chain, under pid_lock
+  struct list sleeplink;       // Sleep queue of chan, under that queue's lock
+  struct list runlink;         // Run queue, under runq lock
+  struct list timerlink;       // In sleepuntil(), under timedq lock
+  uint wakeat;                 // Tick sleepuntil() is to wake at
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
-  uint64 sz;                   // Size of process memory (bytes)
-  pagetable_t pagetable;    // User lower half address page table
+  struct mm *mm;               // Address space, shared with threads
+  uint64 tfva;                 // Where trapframe is mapped in mm->pagetable
   struct trapframe *trapframe; // data page for uservec.S, use DMW address
   struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
   int slot;                     //time slot(ticks)
+  uint nswitch;                // Times this process gave up the CPU
   int priority;   //Process priority(0-20)
-  uint shm;
-  uint shmkeymask;
-  void* shmva[8];
-  uint mqmask;
-  struct vma vm[10];
+  uint cpumask;   //CPUs allowed to run this process; set under p->lock and runq lock
+  uint64 mqmask[MQMAX/64];      // bit i: uses message queue i
 };
 
 #define SLOT 8  //time slices
+#define NPRIO 21  // priorities 0 (most urgent) .. 20
+#define ALLCPUS ((1U << NCPU) - 1)  // cpumask of every CPU
 
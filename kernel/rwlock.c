@@ -0,0 +1,156 @@
+// Reader-writer spin locks and sequence locks.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "rwlock.h"
+#include "loongarch.h"
+#include "defs.h"
+
+#define RWWRITER 0x80000000
+
+void
+initrwlock(struct rwlock *rw, char *name)
+{
+  rw->name = name;
+  rw->state = 0;
+  rw->wwait = 0;
+  rw->class = lockclass(name);
+  rw->t0 = 0;
+}
+
+static int
+tryread(struct rwlock *rw)
+{
+  uint s;
+
+  if(__atomic_load_n(&rw->wwait, __ATOMIC_RELAXED) != 0)
+    return 0;
+  s = __atomic_load_n(&rw->state, __ATOMIC_RELAXED);
+  return (s & RWWRITER) == 0 &&
+         __atomic_compare_exchange_n(&rw->state, &s, s + 1, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+static int
+trywrite(struct rwlock *rw)
+{
+  uint s = 0;
+
+  return __atomic_load_n(&rw->state, __ATOMIC_RELAXED) == 0 &&
+         __atomic_compare_exchange_n(&rw->state, &s, RWWRITER, 0,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
+
+// Count an acquisition in rw's class, as acquire() does,
+// and the wait if it began at t.
+static void
+account(struct rwlock *rw, uint64 t)
+{
+  struct lockclass *c = rw->class;
+
+  if(c == 0)
+    return;
+  if(t){
+    __sync_fetch_and_add(&c->ncontended, 1);
+    __sync_fetch_and_add(&c->spin, r_time() - t);
+  }
+  __sync_fetch_and_add(&c->nacquire, 1);
+}
+
+// Like acquire(), interrupts stay off while the lock is held.
+void
+read_acquire(struct rwlock *rw)
+{
+  uint64 t = 0;
+
+  push_off();
+  if(!tryread(rw)){
+    t = r_time();
+    while(!tryread(rw))
+      ;
+  }
+  account(rw, t);
+}
+
+void
+read_release(struct rwlock *rw)
+{
+  if(__atomic_fetch_sub(&rw->state, 1, __ATOMIC_RELEASE) == 0)
+    panic("read_release");
+  pop_off();
+}
+
+void
+write_acquire(struct rwlock *rw)
+{
+  uint64 t = 0;
+
+  push_off();
+  __atomic_fetch_add(&rw->wwait, 1, __ATOMIC_RELAXED);
+  if(!trywrite(rw)){
+    t = r_time();
+    while(!trywrite(rw))
+      ;
+  }
+  __atomic_fetch_sub(&rw->wwait, 1, __ATOMIC_RELAXED);
+  account(rw, t);
+  rw->t0 = r_time();
+}
+
+void
+write_release(struct rwlock *rw)
+{
+  uint64 hold;
+
+  if(rw->state != RWWRITER)
+    panic("write_release");
+  hold = r_time() - rw->t0;
+  if(rw->class && hold > rw->class->maxhold)
+    rw->class->maxhold = hold;
+  __atomic_store_n(&rw->state, 0, __ATOMIC_RELEASE);
+  pop_off();
+}
+
+void
+initseqlock(struct seqlock *sl, char *name)
+{
+  initlock(&sl->lk, name);
+  sl->seq = 0;
+}
+
+// Start a read; pass the result to read_seqretry().
+uint
+read_seqbegin(struct seqlock *sl)
+{
+  uint s;
+
+  while((s = __atomic_load_n(&sl->seq, __ATOMIC_ACQUIRE)) & 1)
+    ;
+  return s;
+}
+
+// Whether the data read since read_seqbegin() returned
+// seq may be torn, and must be read again.
+int
+read_seqretry(struct seqlock *sl, uint seq)
+{
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&sl->seq, __ATOMIC_RELAXED) != seq;
+}
+
+void
+write_seqlock(struct seqlock *sl)
+{
+  acquire(&sl->lk);
+  __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void
+write_sequnlock(struct seqlock *sl)
+{
+  __atomic_store_n(&sl->seq, sl->seq + 1, __ATOMIC_RELEASE);
+  release(&sl->lk);
+}
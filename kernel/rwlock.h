@@ -0,0 +1,25 @@
+// Reader-writer spin lock.
+// Any number of readers, or one writer. A waiting writer
+// turns new readers away, so a stream of readers cannot
+// starve it.
+struct rwlock {
+  uint state;        // RWWRITER if write-held, else the number of readers
+  uint wwait;        // writers waiting
+
+  // For debugging:
+  char *name;        // Name of lock.
+
+  // For statistics, as in struct spinlock. Only write
+  // holds count towards the class's maxhold.
+  struct lockclass *class;
+  uint64 t0;         // When the writer acquired it.
+};
+
+// Sequence lock, for small data that is read far more often
+// than written. Readers take no lock: they read seq, copy the
+// data and retry if seq was odd or has changed meanwhile.
+// Writers serialize on lk and make seq odd while they write.
+struct seqlock {
+  uint seq;
+  struct spinlock lk;
+};
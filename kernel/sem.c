@@ -0,0 +1,374 @@
+// Counting semaphores.
+//
+// Semaphores come from a slab cache. An id names a slot of
+// semtab together with the slot's generation, so ids of freed
+// semaphores go stale rather than naming their successors.
+//
+// Each semaphore keeps its waiters in FIFO order. sem_v()
+// hands a unit straight to the oldest sem_p() waiter and wakes
+// only that one, which then has nothing to retry. semop()
+// locks every semaphore it names, in address order, and applies
+// all of its operations only if none must wait; otherwise it
+// leaves a retry waiter on each of them and sleeps until one
+// changes.
+//
+// Freeing a semaphore wakes its waiters, which fail. The memory
+// goes back to the cache once the last of them has let go.
+//
+// Lock order: semtab.lock, then semaphores in address order,
+// then semoplock.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "loongarch.h"
+#include "list.h"
+#include "proc.h"
+#include "sem.h"
+#include "slab.h"
+#include "defs.h"
+
+#define NSEMID 1024
+#define MAXGEN (0x7fffffff / NSEMID)
+
+struct semop_wait {
+  int woken;                 // under semoplock
+};
+
+struct semwaiter {
+  struct list link;          // on sem's waiters, under its lock
+  struct semop_wait *ow;     // semop() retry waiter, or 0 for sem_p()
+  int granted;               // sem_p(): handed a unit by sem_v()
+};
+
+struct sem {
+  struct spinlock lock;
+  int value;
+  int npwait;                // sem_p() waiters on waiters
+  int nretry;                // semop() waiters on waiters
+  int nref;                  // waiters that will look at this sem again
+  int dead;                  // freed; waiters must fail
+  struct list waiters;       // oldest first
+};
+
+static struct kmem_cache sem_cache;
+static struct spinlock semoplock;
+
+static struct {
+  struct spinlock lock;
+  struct sem *sem[NSEMID];
+  int gen[NSEMID];
+  int next[NSEMID];          // free slot chain
+  int free;                  // first free slot, or -1
+} semtab;
+
+void
+seminit(void)
+{
+  int i;
+
+  kmem_cache_init(&sem_cache, "sem", sizeof(struct sem));
+  initlock(&semtab.lock, "semtab");
+  initlock(&semoplock, "semop");
+  for(i = 0; i < NSEMID; i++)
+    semtab.next[i] = i + 1 < NSEMID ? i + 1 : -1;
+  semtab.free = 0;
+}
+
+// The semaphore named id, or 0. Caller holds semtab.lock.
+static struct sem*
+semfind(int id)
+{
+  int slot;
+
+  if(id < 0)
+    return 0;
+  slot = id % NSEMID;
+  if(semtab.gen[slot] != id / NSEMID)
+    return 0;
+  return semtab.sem[slot];
+}
+
+// Find and lock the semaphore named id, or return 0.
+static struct sem*
+semlock(int id)
+{
+  struct sem *s;
+
+  acquire(&semtab.lock);
+  if((s = semfind(id)) != 0)
+    acquire(&s->lock);
+  release(&semtab.lock);
+  return s;
+}
+
+// Release s, freeing it if it has died and nobody is left.
+static void
+semunlock(struct sem *s)
+{
+  if(s->dead && s->nref == 0){
+    release(&s->lock);
+    kmem_cache_free(&sem_cache, s);
+    return;
+  }
+  release(&s->lock);
+}
+
+// s->value may have gone up or down: hand units to sem_p()
+// waiters in FIFO order, and let semop() waiters try again.
+static void
+semwake(struct sem *s)
+{
+  struct list *e, *next;
+  struct semwaiter *w;
+
+  for(e = s->waiters.next; e != &s->waiters; e = next){
+    next = e->next;
+    w = list_entry(e, struct semwaiter, link);
+    if(w->ow){
+      acquire(&semoplock);
+      w->ow->woken = 1;
+      wakeup(w->ow);
+      release(&semoplock);
+    } else if(s->value > 0){
+      s->value--;
+      s->npwait--;
+      list_del(&w->link);
+      w->granted = 1;
+      wakeup(w);
+    } else if(s->nretry == 0){
+      break;
+    }
+  }
+}
+
+int
+semcreate(int value)
+{
+  struct sem *s;
+  int slot;
+
+  if(value < 0 || (s = kmem_cache_alloc(&sem_cache)) == 0)
+    return -1;
+  initlock(&s->lock, "sem");
+  s->value = value;
+  s->npwait = 0;
+  s->nretry = 0;
+  s->nref = 0;
+  s->dead = 0;
+  list_init(&s->waiters);
+
+  acquire(&semtab.lock);
+  if((slot = semtab.free) < 0){
+    release(&semtab.lock);
+    kmem_cache_free(&sem_cache, s);
+    return -1;
+  }
+  semtab.free = semtab.next[slot];
+  semtab.sem[slot] = s;
+  release(&semtab.lock);
+  return semtab.gen[slot] * NSEMID + slot;
+}
+
+// Free the semaphore; its waiters fail.
+int
+semfree(int id)
+{
+  struct list *e;
+  struct semwaiter *w;
+  struct sem *s;
+  int slot;
+
+  acquire(&semtab.lock);
+  if((s = semfind(id)) == 0){
+    release(&semtab.lock);
+    return -1;
+  }
+  acquire(&s->lock);
+  slot = id % NSEMID;
+  semtab.sem[slot] = 0;
+  semtab.gen[slot] = (semtab.gen[slot] + 1) % MAXGEN;
+  semtab.next[slot] = semtab.free;
+  semtab.free = slot;
+  release(&semtab.lock);
+
+  s->dead = 1;
+  while((e = list_pop(&s->waiters)) != 0){
+    w = list_entry(e, struct semwaiter, link);
+    if(w->ow){
+      acquire(&semoplock);
+      w->ow->woken = 1;
+      wakeup(w->ow);
+      release(&semoplock);
+    } else {
+      wakeup(w);
+    }
+  }
+  s->npwait = 0;
+  s->nretry = 0;
+  semunlock(s);
+  return 0;
+}
+
+// Take a unit of the semaphore. Fails at once if nowait is
+// set and it would have to wait; if timed is set, fails once
+// ticks reaches deadline. Also fails if the process is killed
+// or the semaphore freed.
+int
+semwait(int id, int nowait, int timed, uint deadline)
+{
+  struct proc *p = myproc();
+  struct semwaiter w;
+  struct sem *s;
+
+  if((s = semlock(id)) == 0)
+    return -1;
+  // no barging past sem_p() waiters, to keep FIFO order.
+  if(s->value > 0 && s->npwait == 0){
+    s->value--;
+    if(s->nretry)
+      semwake(s);
+    release(&s->lock);
+    return 0;
+  }
+  if(nowait){
+    release(&s->lock);
+    return -1;
+  }
+
+  w.ow = 0;
+  w.granted = 0;
+  list_add_tail(&s->waiters, &w.link);
+  s->npwait++;
+  s->nref++;
+  while(!w.granted){
+    if(s->dead || p->killed || (timed && (int)(ticks - deadline) >= 0)){
+      if(!s->dead)
+        s->npwait--;
+      list_del(&w.link);
+      break;
+    }
+    if(timed)
+      sleepuntil(&w, &s->lock, deadline);
+    else
+      sleep(&w, &s->lock);
+  }
+  s->nref--;
+  semunlock(s);
+  return w.granted ? 0 : -1;
+}
+
+// Add one unit to the semaphore.
+int
+sempost(int id)
+{
+  struct sem *s;
+
+  if((s = semlock(id)) == 0)
+    return -1;
+  s->value++;
+  semwake(s);
+  release(&s->lock);
+  return 0;
+}
+
+// Apply nops operations from the user array uops all at once.
+int
+semop(uint64 uops, int nops)
+{
+  struct proc *p = myproc();
+  struct sembuf ops[NSEMOPS];
+  struct sem *s[NSEMOPS], *set[NSEMOPS];
+  struct semwaiter w[NSEMOPS];
+  struct semop_wait ow;
+  int val[NSEMOPS], idx[NSEMOPS];
+  int i, j, n, r, block;
+
+  if(nops < 1 || nops > NSEMOPS)
+    return -1;
+  if(copyin(p->mm->pagetable, (char*)ops, uops, nops * sizeof(ops[0])) < 0)
+    return -1;
+
+  // collect the distinct semaphores in address order
+  // and lock them, all while no one can free any.
+  acquire(&semtab.lock);
+  n = 0;
+  for(i = 0; i < nops; i++){
+    if((s[i] = semfind(ops[i].sem_id)) == 0){
+      release(&semtab.lock);
+      return -1;
+    }
+    for(j = 0; j < n && set[j] != s[i]; j++)
+      ;
+    if(j < n)
+      continue;
+    for(j = n++; j > 0 && set[j-1] > s[i]; j--)
+      set[j] = set[j-1];
+    set[j] = s[i];
+  }
+  for(j = 0; j < n; j++)
+    acquire(&set[j]->lock);
+  release(&semtab.lock);
+  for(i = 0; i < nops; i++)
+    for(idx[i] = 0; set[idx[i]] != s[i]; idx[i]++)
+      ;
+
+  for(;;){
+    r = -1;
+    for(j = 0; j < n; j++)
+      if(set[j]->dead)
+        goto out;
+
+    // try the operations in order on copies of the values.
+    for(j = 0; j < n; j++)
+      val[j] = set[j]->value;
+    block = -1;
+    for(i = 0; i < nops && block < 0; i++){
+      j = idx[i];
+      if(ops[i].sem_op == 0 ? val[j] != 0 : val[j] + ops[i].sem_op < 0)
+        block = i;
+      else
+        val[j] += ops[i].sem_op;
+    }
+    if(block < 0){
+      for(j = 0; j < n; j++){
+        if(set[j]->value != val[j]){
+          set[j]->value = val[j];
+          semwake(set[j]);
+        }
+      }
+      r = 0;
+      goto out;
+    }
+    if((ops[block].sem_flg & SEM_NOWAIT) || p->killed)
+      goto out;
+
+    // wait on all of them for any change.
+    ow.woken = 0;
+    for(j = 0; j < n; j++){
+      w[j].ow = &ow;
+      list_add_tail(&set[j]->waiters, &w[j].link);
+      set[j]->nretry++;
+      set[j]->nref++;
+    }
+    acquire(&semoplock);
+    for(j = n - 1; j >= 0; j--)
+      release(&set[j]->lock);
+    while(!ow.woken && !p->killed)
+      sleep(&ow, &semoplock);
+    release(&semoplock);
+    for(j = 0; j < n; j++){
+      acquire(&set[j]->lock);
+      if(!set[j]->dead)
+        set[j]->nretry--;
+      list_del(&w[j].link);
+      set[j]->nref--;
+    }
+  }
+
+out:
+  for(j = n - 1; j >= 0; j--)
+    semunlock(set[j]);
+  return r;
+}
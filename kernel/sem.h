@@ -1 +1,11 @@
-uint sh_var_for_sem_demo;
+// One operation of semop(): add sem_op to semaphore sem_id,
+// waiting until that would not make it negative, or, if
+// sem_op is 0, until the semaphore is 0.
+struct sembuf {
+  int sem_id;
+  short sem_op;
+  short sem_flg;
+};
+
+#define SEM_NOWAIT 0x1   // fail instead of waiting
+#define NSEMOPS    8     // most operations in one semop()
@@ -2,222 +2,358 @@
 #include "param.h"
 #include "loongarch.h"
 #include "spinlock.h"
+#include "list.h"
 #include "proc.h"
 #include "defs.h"
 #include "memlayout.h"
-#define MAX_SHM_PGNUM 4
+#include "shm.h"
 
-struct sharemem
+// 共享内存对象：有名字、任意大小，按 shm_open() 打开，shmat()
+// 映射，shmdt() 解除，shm_unlink() 删除名字。
+//
+// 对象的页不逐页映射：每个对象自带一组末级页表，每张管 2MB，
+// 其中的 PTE 在创建时就填好。shmat() 在进程的 VMA 表里找一段
+// 2MB 对齐的地址，只把这几张页表挂进进程的上一级页目录，映射
+// 8MB 只写 4 个页目录项，所有进程共用同一组页表。TLB 重填例程
+// 只认 4KB 页，这是它之下最接近大页的做法。
+//
+// 对象在名字被删除、且不再有地址空间映射它时释放。fork() 的
+// 子进程在同样的地址继承父进程的映射，exec() 和退出时解除。
+//
+// 锁的顺序：mm->lock，然后 shmlock。
+
+#define LEAFSPAN (512 * PGSIZE)                     // 一张末级页表管的字节数
+#define MAXLEAF  (PGSIZE / sizeof(pagetable_t))     // 最多的末级页表数
+#define MAXGEN   (0x7fffffff / NSHM)
+#define SHMPTE   (PTE_P|PTE_W|PTE_PLV|PTE_MAT|PTE_D|PTE_V)
+
+struct shmobj
 {
-    int refcount;     		//当前共享内存引用数，当引用数为0时才会真正回收
-    int pagenum;		//占用的页数（0-4）
-    void* physaddr[MAX_SHM_PGNUM];   		//对应每页的物理地址
+    char name[SHMNAME];     //名字，删除后为空串
+    int id;                 //-1 表示这一项未用
+    int size;               //字节数
+    int nleaf;              //末级页表数
+    pagetable_t *leaf;      //各张末级页表，数组占一页
+    int nattach;            //映射了它的地址空间数
 };
-struct spinlock shmlock;    			//用于互斥访问的锁
-struct sharemem shmtab[8];  			//整个系统最多8个共享内存
 
-uint64 allocshm(pde_t *pgdir, uint64 oldshm, uint64 newshm, uint64 sz,void *phyaddr[MAX_SHM_PGNUM]);
-int shmadd(uint key, uint pagenum, void* physaddr[MAX_SHM_PGNUM]);
-uint64 mapshm(pde_t *pgdir, uint64 oldshm, uint64 newshm, uint sz, void **physaddr);
-uint64 deallocshm(pde_t *pgdir, uint64 oldshm, uint64 newshm);
-int shmrm(int key);
+struct spinlock shmlock;    			//用于互斥访问的锁
+struct shmobj shmtab[NSHM];
+int shmgen[NSHM];                       //各项的代数，id = 代数 * NSHM + 下标
 
 void
 sharememinit()
 {
     initlock(&shmlock,"shmlock");
-    for(int i = 0;i < 8; i++)
-        shmtab[i].refcount = 0;
+    for(int i = 0;i < NSHM; i++)
+        shmtab[i].id = -1;
     printf("shm init finished.\n");
 }
 
-int
-shmkeyused(uint key, uint mask)
+// 释放末级页表和它们映射的页
+static void
+shmfree(pagetable_t *leaf)
 {
-    if(key < 0 || 8 <= key)
-        return 0;
-    return (mask >> key) & 0x1;
+    for(int i = 0; i < MAXLEAF && leaf[i]; i++){
+        for(int j = 0; j < 512; j++)
+            if(leaf[i][j] & PTE_V)
+                kfree((void*)(PTE2PA(leaf[i][j]) | DMWIN_MASK));
+        kfree(leaf[i]);
+    }
+    kfree(leaf);
 }
 
-void*
-shmgetat(uint key, uint num)
+// 分配 size 字节清零的页和映射它们的末级页表，失败返回 0
+static pagetable_t*
+shmbuild(int size)
 {
-    pde_t *pgdir;
-    struct proc* p;
-    void *phyaddr[MAX_SHM_PGNUM];
-    uint64 shm = 0;
-    if(key<0||8<=key||num<0||MAX_SHM_PGNUM<num) 	//校验参数
-        return (void*)-1;
-    acquire(&shmlock);
-    p = myproc();
-    pgdir = p->pagetable;
-    shm = p->shm;
-
-
-    // 情况1.如果当前进程已经映射了该key的共享内存，直接返回地址
-    if(p->shmkeymask>>key & 1){ 
-        release(&shmlock);
-        return p->shmva[key];
-    }
+    pagetable_t *leaf;
+    char *mem;
+    int npages = PGROUNDUP(size) / PGSIZE;
 
-    // 情况2.如果系统还未创建此key对应的共享内存，则分配内存并映射
-    if(shmtab[key].refcount == 0){
-        shm = allocshm(pgdir, shm, shm - num * PGSIZE, p->sz, phyaddr); 
-        //新增的allocshm()分配内存并映射，其原理和allcouvm()相同
-        if(shm == 0){
-            release(&shmlock);
-            return (void*)-1;
+    if((npages + 511) / 512 > MAXLEAF || (leaf = kalloc()) == 0)
+        return 0;
+    memset(leaf, 0, PGSIZE);
+    for(int i = 0; i < npages; i++){
+        if(i % 512 == 0){
+            if((leaf[i / 512] = kalloc()) == 0)
+                goto bad;
+            memset(leaf[i / 512], 0, PGSIZE);
         }
-        p->shmva[key] = (void*)shm;
-        shmadd(key, num, phyaddr);	//将新内存区信息填入shmtab[8]数组
+        if((mem = kalloc()) == 0)
+            goto bad;
+        memset(mem, 0, PGSIZE);
+        leaf[i / 512][i % 512] = PA2PTE(mem) | SHMPTE;
     }
-    else { 
+    return leaf;
 
-        //情况3.如果未持有且已经系统中分配此key对应的共享内存，则直接映射
-        for(int i = 0;i<num;i++)
-        {
-            phyaddr[i] = shmtab[key].physaddr[i];
-        }
-        num = shmtab[key].pagenum;
-		//mapshm方法新建映射
-        if((shm = mapshm(pgdir,shm,shm-num*PGSIZE,p->sz,phyaddr))==0){
-            release(&shmlock);
-            return (void*)-1;
-        }
-         p->shmva[key] = (void*)shm;
-        shmtab[key].refcount++;			//引用计数+1
-    }
-    p->shm = shm;
-    p->shmkeymask |= 1<<key;
-    release(&shmlock);
-    return (void*)shm;
+bad:
+    shmfree(leaf);
+    return 0;
 }
 
-// 这个方法和allcouvm实现基本一样
-uint64
-allocshm(pde_t *pgdir, uint64 oldshm, uint64 newshm, uint64 sz,void *phyaddr[MAX_SHM_PGNUM])
+static struct shmobj*
+shmbyname(char *name)
 {
-    char *mem;
-    uint64 a;
-    
-    if(oldshm & 0xFFF || newshm & 0xFFF || oldshm > (TRAPFRAME - 64 *2 * PGSIZE) || newshm < sz)
+    for(int i = 0; i < NSHM; i++)
+        if(shmtab[i].id >= 0 && strncmp(shmtab[i].name, name, SHMNAME) == 0)
+            return &shmtab[i];
+    return 0;
+}
+
+static struct shmobj*
+shmbyid(int id)
+{
+    struct shmobj *o;
+
+    if(id < 0)
         return 0;
-    a = newshm;
-    // int count = 0;
-    for (int i = 0; a < oldshm; a+=PGSIZE, i++)
-    {
-        // count++;
-        mem = kalloc(); 		//分配物理页帧
-        if(mem == 0){
-            printf("allocshm out of memory\n");
-            deallocshm(pgdir,newshm,oldshm);
-            return 0;
-        }
-        memset(mem,0,PGSIZE);
-        mappages(pgdir,a,PGSIZE,(uint64)(mem),PTE_P|PTE_W|PTE_PLV|PTE_MAT|PTE_D);	//页表映射
-        phyaddr[i] = (void *)(mem);
-        printf("allocshm : %x\n",a);
-    }
-    // printf("count:%d\n",count);
-    return newshm;
+    o = &shmtab[id % NSHM];
+    return o->id == id ? o : 0;
 }
 
-uint64
-mapshm(pde_t *pgdir, uint64 oldshm, uint64 newshm, uint sz, void **physaddr)
-{
-    uint64 a;
-    if(oldshm & 0xFFF || newshm & 0xFFF || oldshm > (TRAPFRAME - 64 *2 * PGSIZE) || newshm < sz)
-        return 0;  												//验证参数
-    a=newshm;
-    for (int i = 0;a<oldshm;a+=PGSIZE, i++) 					//逐页映射
-    {
-        mappages(pgdir,a,PGSIZE,(uint64)physaddr[i],PTE_P|PTE_W|PTE_PLV|PTE_MAT|PTE_D);
-    }
-    return newshm;
+// 没人映射、也没有名字的对象从表中摘下，返回它的页表数组
+// 交给调用者在放开 shmlock 后释放。调用者持有 shmlock。
+static pagetable_t*
+shmidle(struct shmobj *o)
+{
+    int slot = o - shmtab;
+
+    if(o->nattach > 0 || o->name[0])
+        return 0;
+    o->id = -1;
+    shmgen[slot] = (shmgen[slot] + 1) % MAXGEN;
+    return o->leaf;
 }
 
+// 打开名为 name 的对象，返回它的 id。不存在时若 flags 有
+// SHM_CREAT 就创建 size 字节的新对象；已存在时要求 size 不超过
+// 它的大小，flags 有 SHM_EXCL 则失败。
 int
-shmadd(uint key, uint pagenum, void* physaddr[MAX_SHM_PGNUM])
+shmopen(char *name, int size, int flags)
 {
-    if(key<0 || 8<=key || pagenum<0 || MAX_SHM_PGNUM < pagenum){
+    struct shmobj *o;
+    pagetable_t *leaf = 0;
+    int i, id = -1;
+
+    if(name[0] == 0 || size < 0)
         return -1;
+    acquire(&shmlock);
+    o = shmbyname(name);
+    if(o == 0 && (flags & SHM_CREAT) && size > 0){
+        release(&shmlock);
+        leaf = shmbuild(size);          //可能有好几 MB，不持锁
+        acquire(&shmlock);
+        if(leaf && (o = shmbyname(name)) == 0){
+            for(i = 0; i < NSHM && shmtab[i].id >= 0; i++)
+                ;
+            if(i < NSHM){
+                o = &shmtab[i];
+                safestrcpy(o->name, name, SHMNAME);
+                o->id = shmgen[i] * NSHM + i;
+                o->size = size;
+                o->nleaf = (PGROUNDUP(size) / PGSIZE + 511) / 512;
+                o->leaf = leaf;
+                o->nattach = 0;
+                leaf = 0;
+                flags &= ~SHM_EXCL;     //是自己创建的
+            }
+        }
     }
-    shmtab[key].refcount = 1;
-    shmtab[key].pagenum = pagenum;
-    for(int i = 0;i<pagenum;++i){
-        shmtab[key].physaddr[i] = physaddr[i];
+    if(o && !(flags & SHM_EXCL) && size <= o->size)
+        id = o->id;
+    release(&shmlock);
+    if(leaf)                            //别人抢先创建了同名对象
+        shmfree(leaf);
+    return id;
+}
+
+// 删除名字。已映射的进程照常使用，最后一个解除时释放。
+int
+shmunlink(char *name)
+{
+    struct shmobj *o;
+    pagetable_t *leaf = 0;
+
+    acquire(&shmlock);
+    if((o = shmbyname(name)) == 0){
+        release(&shmlock);
+        return -1;
     }
+    o->name[0] = 0;
+    leaf = shmidle(o);
+    release(&shmlock);
+    if(leaf)
+        shmfree(leaf);
     return 0;
 }
 
 void
-shmaddcount(uint mask)
+shmdup(struct shmobj *o)
 {
     acquire(&shmlock);
-    for (int key = 0; key < 8; key++)
-    {
-        if(shmkeyused(key,mask)){   //对目前进程所有引用的共享内存的引用数加1
-            shmtab[key].refcount++;   
-        }
-    }
+    o->nattach++;
     release(&shmlock);
 }
 
-uint64
-deallocshm(pde_t *pgdir, uint64 oldshm, uint64 newshm)
-{ 
-    if(newshm <= oldshm)
-        return oldshm;
-
-    if(PGROUNDUP(newshm) > PGROUNDUP(oldshm)){
-        int npages = (PGROUNDUP(newshm) - PGROUNDUP(oldshm)) / PGSIZE;
-        uvmunmap(pgdir, PGROUNDUP(oldshm), npages, 1);
-    }
+// 一个地址空间不再映射 o
+void
+shmput(struct shmobj *o)
+{
+    pagetable_t *leaf;
 
-    return oldshm;
+    acquire(&shmlock);
+    o->nattach--;
+    leaf = shmidle(o);
+    release(&shmlock);
+    if(leaf)
+        shmfree(leaf);
 }
 
+// 把 o 的末级页表挂到 pagetable 中 va 开始的几个 2MB 上，
+// va 按 2MB 对齐。那里原有的空页表释放掉。失败时什么也不挂。
 int
-shmrm(int key)
+shmmap(pagetable_t pagetable, uint64 va, struct shmobj *o)
 {
-    if(key<0||8<=key){
+    pte_t *pmd;
+    pagetable_t old;
+    int i, j;
+
+    for(i = 0; i < o->nleaf; i++){
+        if((pmd = walkpmd(pagetable, va + i * LEAFSPAN, 1)) == 0)
+            goto bad;
+        if(*pmd & PTE_V){               //曾经映射过别的东西，留下了空页表
+            old = (pagetable_t)(PTE2PA(*pmd) | DMWIN_MASK);
+            for(j = 0; j < 512 && old[j] == 0; j++)
+                ;
+            if(j < 512)
+                goto bad;
+            kfree(old);
+        }
+        *pmd = PA2PTE(o->leaf[i]) | PTE_V;
+    }
+    return 0;
+
+bad:
+    shmunmap(pagetable, va, o);
+    return -1;
+}
+
+// 摘下 shmmap() 挂上的页表，页表和页都不释放
+void
+shmunmap(pagetable_t pagetable, uint64 va, struct shmobj *o)
+{
+    pte_t *pmd;
+
+    for(int i = 0; i < o->nleaf; i++){
+        pmd = walkpmd(pagetable, va + i * LEAFSPAN, 0);
+        if(pmd && (*pmd & PTE_V) && PTE2PA(*pmd) == PA2PTE(o->leaf[i]))
+            *pmd = 0;
+    }
+}
+
+// 把对象 id 映射到本进程，返回地址，失败返回 -1
+uint64
+shmat(int id)
+{
+    struct mm *mm = myproc()->mm;
+    struct shmobj *o;
+    uint64 va;
+
+    acquire(&shmlock);
+    if((o = shmbyid(id)) != 0)
+        o->nattach++;
+    release(&shmlock);
+    if(o == 0)
         return -1;
+
+    acquire(&mm->lock);
+    va = vmareserve(mm, o->nleaf * LEAFSPAN, LEAFSPAN, o);
+    if(va != 0 && shmmap(mm->pagetable, va, o) < 0){
+        vmaremove(mm, va);
+        va = 0;
     }
-    //cprintf("shmrm: key is %d\n",key);
-    struct sharemem* shmem = &shmtab[key];
-    for(int i=0;i<shmem->pagenum;i++){
-        kfree((char*)(shmem->physaddr[i]));   		//逐个页帧回收
+    release(&mm->lock);
+    if(va == 0){
+        shmput(o);
+        return -1;
     }
-    shmem->refcount = 0;
-    return 0;    
+    return va;
 }
 
+// 解除 shmat() 在 addr 处的映射
 int
-shmrelease(pde_t *pgdir, uint64 shm, uint keymask)
+shmdt(uint64 addr)
 {
-    //cprintf("shmrelease: shm is %x, keymask is %x.\n",shm, keymask);
-    acquire(&shmlock);
-    deallocshm(pgdir,shm, TRAPFRAME - 64 *2 * PGSIZE); 				//释放用户空间的内存
-    for (int k = 0; k < 8; k++)
-    {
-        if(shmkeyused(k,keymask)){
-            shmtab[k].refcount--;   					//引用数目减1
-            if(shmtab[k].refcount==0){  				//若为0 ，即可以回收物理内存
-                shmrm(k);    
-            }
-        }
+    struct mm *mm = myproc()->mm;
+    struct shmobj *o = 0;
+    struct vma *v;
+
+    acquire(&mm->lock);
+    if((v = vmalookup(mm, addr)) != 0 && (o = v->shm) != 0){
+        shmunmap(mm->pagetable, addr, o);
+        vmaremove(mm, addr);
     }
-    release(&shmlock);
+    release(&mm->lock);
+    if(o == 0)
+        return -1;
+    shmput(o);
     return 0;
 }
 
+// 旧接口：key 对应名为 "#key" 的对象，num 页。
+// 本进程已经映射了它时返回原来的地址。
+static void
+keyname(uint key, char *name)
+{
+    char buf[SHMNAME];
+    int i = 0;
+
+    do {
+        buf[i++] = '0' + key % 10;
+        key /= 10;
+    } while(key);
+    *name++ = '#';
+    while(i > 0)
+        *name++ = buf[--i];
+    *name = 0;
+}
+
+void*
+shmgetat(uint key, uint num)
+{
+    struct mm *mm = myproc()->mm;
+    struct vma *vm = mm->vm;
+    char name[SHMNAME];
+    struct shmobj *o;
+    uint64 va = 0;
+    int id;
+
+    keyname(key, name);
+    if(num > 0x7fffffff / PGSIZE || (id = shmopen(name, num * PGSIZE, SHM_CREAT)) < 0)
+        return (void*)-1;
+    acquire(&mm->lock);
+    for(int i = vm[0].next; i != 0; i = vm[i].next)
+        if((o = vm[i].shm) != 0 && o->id == id)
+            va = vm[i].address;
+    release(&mm->lock);
+    if(va == 0)
+        va = shmat(id);
+    return (void*)va;
+}
+
+// 映射 key 对应对象的地址空间数
 int
 shmrefcount(uint key)
 {
-    acquire(&shmlock);
+    char name[SHMNAME];
+    struct shmobj *o;
     int count;
-    count = (key<0||8<=key)? -1:shmtab[key].refcount;
+
+    keyname(key, name);
+    acquire(&shmlock);
+    o = shmbyname(name);
+    count = o ? o->nattach : -1;
     release(&shmlock);
     return count;
 }
-
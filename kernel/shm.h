@@ -0,0 +1,4 @@
+// Shared memory objects, for shm_open().
+#define SHM_CREAT 0x1    // create the object if it does not exist
+#define SHM_EXCL  0x2    // with SHM_CREAT, fail if it exists
+#define SHMNAME   16     // longest name, with its terminating 0
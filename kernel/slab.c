@@ -0,0 +1,119 @@
+// Slab allocator for fixed-size kernel objects.
+//
+// kalloc() hands out whole pages; structures such as
+// struct proc are much smaller, so a kmem_cache carves
+// pages into equal-sized objects and keeps the pages on
+// a partial list while they still have room. Freeing
+// an object finds its slab by rounding down to the page.
+// Empty slabs go back to kalloc() unless they are the
+// only ones left with free space.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "loongarch.h"
+#include "list.h"
+#include "slab.h"
+#include "defs.h"
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7UL)
+
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  size = (size + 7) & ~7U;
+  if(size < sizeof(void*) || SLABHDR + size > PGSIZE)
+    panic("kmem_cache_init");
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+  list_init(&c->partial);
+  list_init(&c->full);
+  c->nslab = 0;
+  c->nobj = 0;
+}
+
+// Carve a fresh page into objects.
+// Called without c->lock since kalloc() takes kmem.lock.
+static struct slab*
+newslab(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *o;
+  int i;
+
+  if((s = (struct slab*)kalloc()) == 0)
+    return 0;
+  s->cache = c;
+  s->inuse = 0;
+  s->free = 0;
+  o = (char*)s + SLABHDR + (c->perslab - 1) * c->size;
+  for(i = 0; i < c->perslab; i++, o -= c->size){
+    *(void**)o = s->free;
+    s->free = o;
+  }
+  list_init(&s->link);
+  return s;
+}
+
+// Allocate one object. Contents are uninitialized.
+// Returns 0 if out of memory.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct slab *s;
+  void *o;
+
+  acquire(&c->lock);
+  if(list_empty(&c->partial)){
+    release(&c->lock);
+    if((s = newslab(c)) == 0)
+      return 0;
+    acquire(&c->lock);
+    list_add(&c->partial, &s->link);
+    c->nslab++;
+  }
+  s = list_entry(c->partial.next, struct slab, link);
+  o = s->free;
+  s->free = *(void**)o;
+  s->inuse++;
+  if(s->free == 0){
+    list_del(&s->link);
+    list_add(&c->full, &s->link);
+  }
+  c->nobj++;
+  release(&c->lock);
+  return o;
+}
+
+void
+kmem_cache_free(struct kmem_cache *c, void *o)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint64)o);
+  int wasfull;
+
+  if(s->cache != c)
+    panic("kmem_cache_free");
+
+  acquire(&c->lock);
+  wasfull = s->free == 0;
+  *(void**)o = s->free;
+  s->free = o;
+  s->inuse--;
+  c->nobj--;
+  if(wasfull){
+    list_del(&s->link);
+    list_add(&c->partial, &s->link);
+  }
+  if(s->inuse == 0 && c->partial.next->next != &c->partial){
+    // keep one partial slab around; give the rest back.
+    list_del(&s->link);
+    c->nslab--;
+    release(&c->lock);
+    kfree((void*)s);
+    return;
+  }
+  release(&c->lock);
+}
@@ -0,0 +1,21 @@
+// Object caches for fixed-size kernel structures.
+// Each slab is one kalloc() page: a struct slab header
+// followed by as many objects as fit.
+
+struct slab {
+  struct list link;         // on cache's partial or full list
+  struct kmem_cache *cache;
+  void *free;               // free objects, linked through their first word
+  int inuse;                // allocated objects in this slab
+};
+
+struct kmem_cache {
+  struct spinlock lock;
+  char *name;
+  uint size;                // object size, rounded up to 8 bytes
+  uint perslab;             // objects per slab
+  struct list partial;      // slabs with at least one free object
+  struct list full;         // slabs with no free objects
+  int nslab;                // pages currently owned by the cache
+  int nobj;                 // objects currently allocated
+};
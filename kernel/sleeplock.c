@@ -1,4 +1,10 @@
 // Sleeping locks
+//
+// locked is 0 when free, 1 when held and 2 when held with
+// sleepers that may need waking. An uncontended acquire or
+// release is a single atomic instruction on locked; only
+// contended ones take the inner spinlock, which orders the
+// sleepers' last look at locked against the releaser's wakeup.
 
 #include "types.h"
 #include "loongarch.h"
@@ -6,6 +12,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "list.h"
 #include "proc.h"
 #include "sleeplock.h"
 
@@ -21,32 +28,42 @@ initsleeplock(struct sleeplock *lk, char *name)
 void
 acquiresleep(struct sleeplock *lk)
 {
-  acquire(&lk->lk);
-  while (lk->locked) {
-    sleep(lk, &lk->lk);
+  uint free = 0;
+
+#ifdef LOCKDEP
+  // may sleep, whether or not it does this time.
+  lockdep_sleep(0);
+#endif
+  if(!__atomic_compare_exchange_n(&lk->locked, &free, 1, 0,
+                                  __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+    // mark the lock contended before each look, so
+    // that whoever holds it will wake us on release.
+    acquire(&lk->lk);
+    while(__atomic_exchange_n(&lk->locked, 2, __ATOMIC_ACQUIRE) != 0)
+      sleep(lk, &lk->lk);
+    release(&lk->lk);
   }
-  lk->locked = 1;
-  lk->pid = myproc()->pid;
-  release(&lk->lk);
+  __atomic_store_n(&lk->pid, myproc()->pid, __ATOMIC_RELAXED);
 }
 
 void
 releasesleep(struct sleeplock *lk)
 {
-  acquire(&lk->lk);
-  lk->locked = 0;
-  lk->pid = 0;
-  wakeup(lk);
-  release(&lk->lk);
+  __atomic_store_n(&lk->pid, 0, __ATOMIC_RELAXED);
+  if(__atomic_exchange_n(&lk->locked, 0, __ATOMIC_RELEASE) == 2){
+    // waking one is enough: it sets locked to 2
+    // again before it either sleeps or takes the lock.
+    acquire(&lk->lk);
+    wakeup1p(lk);
+    release(&lk->lk);
+  }
 }
 
+// Only the holder can find its own pid here, so
+// this needs no lock.
 int
 holdingsleep(struct sleeplock *lk)
 {
-  int r;
-  
-  acquire(&lk->lk);
-  r = lk->locked && (lk->pid == myproc()->pid);
-  release(&lk->lk);
-  return r;
-}
\ No newline at end of file
+  return __atomic_load_n(&lk->locked, __ATOMIC_RELAXED) != 0 &&
+         __atomic_load_n(&lk->pid, __ATOMIC_RELAXED) == myproc()->pid;
+}
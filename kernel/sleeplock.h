@@ -1,7 +1,7 @@
 struct sleeplock {
-  uint locked;       // Is the lock held?
-  struct spinlock lk; // spinlock protecting this sleep lock
-  
+  uint locked;       // 0 free, 1 held, 2 held with sleepers
+  struct spinlock lk; // orders sleepers against the releaser's wakeup
+
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
@@ -5,28 +5,267 @@
 #include "memlayout.h"
 #include "spinlock.h"
 #include "loongarch.h"
+#include "list.h"
 #include "proc.h"
 #include "defs.h"
 
+// Lock classes, by name. The last slot collects
+// the locks of any names that do not fit.
+#define NLOCKCLASS 64
+static struct lockclass classes[NLOCKCLASS];
+static int nclass;
+static uint classlock;   // serializes adding classes
+
+static struct lockclass*
+findclass(char *name, int from, int to)
+{
+  for(int i = from; i < to; i++)
+    if(classes[i].name == name || strncmp(classes[i].name, name, 32) == 0)
+      return &classes[i];
+  return 0;
+}
+
+// The class of locks named name, added if new.
+// Names are compared by contents, since the same
+// literal may be stored once per file. Reader-writer
+// locks share the table.
+struct lockclass*
+lockclass(char *name)
+{
+  struct lockclass *c;
+  int n;
+
+  n = __atomic_load_n(&nclass, __ATOMIC_ACQUIRE);
+  if((c = findclass(name, 0, n)) != 0)
+    return c;
+
+  push_off();
+  while(__sync_lock_test_and_set(&classlock, 1) != 0)
+    ;
+  if((c = findclass(name, n, nclass)) == 0){
+    if(nclass < NLOCKCLASS - 1){
+      c = &classes[nclass];
+      c->name = name;
+      __atomic_store_n(&nclass, nclass + 1, __ATOMIC_RELEASE);
+    } else {
+      c = &classes[NLOCKCLASS - 1];
+      c->name = "(other)";
+    }
+  }
+  __sync_lock_release(&classlock);
+  pop_off();
+  return c;
+}
+
+#ifdef LOCKDEP
+// Lock dependency validator, built with make LOCKDEP=1.
+//
+// Each cpu keeps a stack of the spinlocks it holds. Taking a
+// lock of class B while holding one of class A records the
+// edge A -> B. If B already reaches A along recorded edges,
+// some other path takes the two in the opposite order and the
+// pair can deadlock; the validator prints both chains and goes
+// on. Only new edges are checked, so once the graph has
+// settled the cost is a bit test per held lock. Locks of one
+// class are not ordered against each other.
+
+#define NHELD 16
+#define BIT(c) (1UL << (c))
+
+static struct {
+  struct spinlock *held[NHELD];
+  int n;
+  int busy;                        // in the validator: don't check
+} ldcpu[NCPU];
+
+static uint64 after[NLOCKCLASS];   // bit b of after[a]: edge a -> b
+static uint64 reported[NLOCKCLASS];
+static uint64 sleepreported;
+static uint graphlock;
+
+// Find a path of edges from class from to class to.
+// Fills path, from first, and returns its length, or 0.
+static int
+findpath(int from, int to, int *path)
+{
+  int prev[NLOCKCLASS], q[NLOCKCLASS];
+  int head = 0, tail = 0, c, i, n;
+  uint64 seen = BIT(from);
+
+  q[tail++] = from;
+  while(head < tail && (seen & BIT(to)) == 0){
+    c = q[head++];
+    for(i = 0; i < NLOCKCLASS; i++){
+      if((after[c] & BIT(i)) && (seen & BIT(i)) == 0){
+        seen |= BIT(i);
+        prev[i] = c;
+        q[tail++] = i;
+      }
+    }
+  }
+  if((seen & BIT(to)) == 0)
+    return 0;
+  n = 1;
+  for(c = to; c != from; c = prev[c])
+    n++;
+  i = n;
+  for(c = to; c != from; c = prev[c])
+    path[--i] = c;
+  path[0] = from;
+  return n;
+}
+
+static void
+printheld(int id)
+{
+  printf("lockdep: cpu %d holds:", id);
+  for(int i = 0; i < ldcpu[id].n; i++)
+    printf(" %s", ldcpu[id].held[i]->name);
+  printf("\n");
+}
+
+// lk is about to be acquired on cpu id.
+static void
+lockdep_check(int id, struct spinlock *lk)
+{
+  int a, b, i, n, path[NLOCKCLASS];
+
+  b = lk->class - classes;
+  for(i = 0; i < ldcpu[id].n; i++){
+    if(ldcpu[id].held[i]->class == 0)
+      continue;
+    a = ldcpu[id].held[i]->class - classes;
+    if(a == b || (after[a] & BIT(b)))
+      continue;
+
+    while(__sync_lock_test_and_set(&graphlock, 1) != 0)
+      ;
+    if((n = findpath(b, a, path)) == 0){
+      after[a] |= BIT(b);
+      n = -1;
+    } else if(reported[a] & BIT(b)){
+      n = -1;
+    } else {
+      reported[a] |= BIT(b);
+    }
+    __sync_lock_release(&graphlock);
+    if(n < 0)
+      continue;
+
+    printf("lockdep: cpu %d takes %s while holding %s,\n", id,
+           classes[b].name, classes[a].name);
+    printf("lockdep: but earlier");
+    for(int j = 0; j < n; j++)
+      printf(j ? " -> %s" : " %s", classes[path[j]].name);
+    printf("\n");
+    printheld(id);
+  }
+}
+
+static void
+lockdep_acquire(struct spinlock *lk)
+{
+  int id = cpuid();
+
+  if(lk->class && !ldcpu[id].busy){
+    ldcpu[id].busy = 1;
+    lockdep_check(id, lk);
+    ldcpu[id].busy = 0;
+  }
+  if(ldcpu[id].n < NHELD)
+    ldcpu[id].held[ldcpu[id].n] = lk;
+  ldcpu[id].n++;
+}
+
+// Locks need not be released in the order taken.
+static void
+lockdep_release(struct spinlock *lk)
+{
+  int id = cpuid();
+  int i, n = ldcpu[id].n;
+
+  if(n > NHELD)
+    n = NHELD;
+  for(i = n - 1; i >= 0; i--){
+    if(ldcpu[id].held[i] == lk){
+      for(; i < n - 1; i++)
+        ldcpu[id].held[i] = ldcpu[id].held[i+1];
+      break;
+    }
+  }
+  ldcpu[id].n--;
+}
+
+// The caller may sleep holding lk, or no spinlock if lk is 0.
+// Any other spinlock held here could be wanted by whoever
+// would wake us up.
 void
-initlock(struct spinlock *lk, char *name)
+lockdep_sleep(struct spinlock *lk)
 {
+  int id, i, c, bad = 0;
+
+  push_off();
+  id = cpuid();
+  for(i = 0; i < ldcpu[id].n && i < NHELD; i++){
+    if(ldcpu[id].held[i] == lk || ldcpu[id].held[i]->class == 0)
+      continue;
+    c = ldcpu[id].held[i]->class - classes;
+    if((__sync_fetch_and_or(&sleepreported, BIT(c)) & BIT(c)) == 0){
+      printf("lockdep: cpu %d may sleep holding %s\n", id,
+             ldcpu[id].held[i]->name);
+      bad = 1;
+    }
+  }
+  if(bad)
+    printheld(id);
+  pop_off();
+}
+#endif
+
+// Called through the initlock() macro, which gives each call
+// site a cache of the class its last lock got. Sites that make
+// a lock per object (proc, pipe, sem) then skip the search.
+void
+initlockclass(struct spinlock *lk, char *name, struct lockclass **cache)
+{
+  struct lockclass *c = *cache;
+
+  if(c == 0 || (c->name != name && strncmp(c->name, name, 32) != 0))
+    *cache = c = lockclass(name);
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->class = c;
+  lk->t0 = 0;
 }
 
 // Acquire the lock.
-// Loops (spins) until the lock is acquired.
+// Loops (spins) until our ticket comes up.
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  uint64 t;
+  struct lockclass *c = lk->class;
+
   push_off(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
+#ifdef LOCKDEP
+  lockdep_acquire(lk);
+#endif
 
-  while(__sync_lock_test_and_set(&lk->locked, 1) != 0)
-    ;
+  ticket = __sync_fetch_and_add(&lk->next, 1);
+  if(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket){
+    t = r_time();
+    while(__atomic_load_n(&lk->owner, __ATOMIC_ACQUIRE) != ticket)
+      ;
+    if(c){
+      __sync_fetch_and_add(&c->ncontended, 1);
+      __sync_fetch_and_add(&c->spin, r_time() - t);
+    }
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -35,16 +274,29 @@ acquire(struct spinlock *lk)
 
   // Record info about lock acquisition for holding() and debugging.
   lk->cpu = mycpu();
+  if(c)
+    __sync_fetch_and_add(&c->nacquire, 1);
+  lk->t0 = r_time();
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  uint64 hold;
+
   if(!holding(lk))
     panic("release");
 
+  // racy between locks of one class, but only statistics.
+  hold = r_time() - lk->t0;
+  if(lk->class && hold > lk->class->maxhold)
+    lk->class->maxhold = hold;
+
   lk->cpu = 0;
+#ifdef LOCKDEP
+  lockdep_release(lk);
+#endif
 
   // Tell the C compiler and the CPU to not move loads or stores
   // past this point, to ensure that all the stores in the critical
@@ -53,11 +305,9 @@ release(struct spinlock *lk)
   // the lock is released.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code doesn't use a C assignment, since the C standard
-  // implies that an assignment might be implemented with
-  // multiple store instructions.
-  __sync_lock_release(&lk->locked);
+  // Serve the next ticket. Only the holder writes owner,
+  // so a plain increment published with a release store will do.
+  __atomic_store_n(&lk->owner, lk->owner + 1, __ATOMIC_RELEASE);
 
   pop_off();
 }
@@ -68,10 +318,33 @@ int
 holding(struct spinlock *lk)
 {
   int r;
-  r = (lk->locked && lk->cpu == mycpu());
+  r = (lk->next != lk->owner && lk->cpu == mycpu());
   return r;
 }
 
+// Print the statistics of every lock class that has
+// been acquired, then clear them if reset is set.
+// Times are in stable counter ticks.
+void
+lockstat(int reset)
+{
+  struct lockclass *c;
+
+  printf("class: acquire contended spin maxhold\n");
+  for(c = classes; c < &classes[NLOCKCLASS]; c++){
+    if(c->name == 0 || c->nacquire == 0)
+      continue;
+    printf("%s: %l %l %l %l\n", c->name, c->nacquire, c->ncontended,
+           c->spin, c->maxhold);
+    if(reset){
+      c->nacquire = 0;
+      c->ncontended = 0;
+      c->spin = 0;
+      c->maxhold = 0;
+    }
+  }
+}
+
 // push_off/pop_off are like intr_off()/intr_on() except that they are matched:
 // it takes two pop_off()s to undo two push_off()s.  Also, if interrupts
 // are initially off, then push_off, pop_off leaves them off.
@@ -99,81 +372,3 @@ pop_off(void)
   if(c->noff == 0 && c->intena)
     intr_on();
 }
-
-int sem_used_count = 0;
-struct sem sems[SEM_MAX_NUM];
-void seminit()
-{
-  int i;
-  for(i = 0;i < SEM_MAX_NUM;i++)
-  {
-    initlock(&(sems[i].lock),"semaphore");
-    sems[i].allocated = 0;
-  }
-}
-
-int
-sys_sem_create()
-{
-  int n_sem, i;
-  if(argint(0, &n_sem) < 0)
-    return -1;
-  for(i = 0;i < SEM_MAX_NUM;i++)	
-  {
-    acquire(&sems[i].lock);
-    if(sems[i].allocated == 0) 
-    {
-      sems[i].allocated = 1;
-      sems[i].resource_count = n_sem;
-      printf("create %d sem\n",i);
-      release(&sems[i].lock);
-      return i;
-    }
-    release(&sems[i].lock);
-  }
-  return -1;
-}
-
-int
-sys_sem_free() 
-{
-  int id;
-  if(argint(0,&id) < 0)
-    return -1;
-  acquire(&sems[id].lock);
-  if(sems[id].allocated == 1 && sems[id].resource_count > 0)
-  {
-    sems[id].allocated = 0;
-    printf("free %d sem\n",id);
-  }
-  release(&sems[id].lock);
-  return 0;
-}
-
-int 
-sys_sem_p()
-{	
-  int id;
-  if(argint(0, &id) < 0)
-    return -1;
- 	acquire(&sems[id].lock);
- 	sems[id].resource_count--;
- 	if(sems[id].resource_count < 0)		//首次进入、或被唤醒时，资源不足
- 		sleep(&sems[id],&sems[id].lock);	//睡眠（会释放sems[id].lock才阻塞）
- 	release(&sems[id].lock); 		//解锁（唤醒到此处时，重新持有sems[id].lock）
- 	return 0; 						//此时获得信号量资源
-}
-
-int
-sys_sem_v()
-{	
-  int id;
-  if(argint(0,&id)<0)
-    return -1;
- 	acquire(&sems[id].lock);
- 	sems[id]. resource_count+=1;		//增1
- 	if(sems[id].resource_count<1)			//有阻塞等待该资源的进程
- 		wakeup1p(&sems[id]);			//唤醒等待该资源的1个进程
- 	release(&sems[id].lock);				//释放锁
- 	return 0;
-}
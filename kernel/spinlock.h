@@ -1,21 +1,26 @@
+// Locks with the same name form a class, which
+// gathers their statistics.
+struct lockclass {
+  char *name;
+  uint64 nacquire;     // acquisitions
+  uint64 ncontended;   // acquisitions that had to wait
+  uint64 spin;         // timer ticks spent waiting
+  uint64 maxhold;      // longest hold, in timer ticks
+};
+
 // Mutual exclusion lock.
+// A ticket lock: acquirers take numbers from next and
+// are served in order as owner counts up, so waiters
+// cannot starve and spin only reading owner.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  uint next;         // Next ticket to hand out.
+  uint owner;        // Ticket being served; held while next != owner.
 
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
-};
 
-#define SEM_MAX_NUM 128
-extern int sem_used_count;
-struct sem
-{
-    struct spinlock lock;
-    int resource_count;
-    int allocated;  
+  // For statistics:
+  struct lockclass *class;
+  uint64 t0;         // When the holder acquired it.
 };
-
-extern struct sem sems[SEM_MAX_NUM];  //signal count
-
-
@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "loongarch.h"
 #include "spinlock.h"
+#include "list.h"
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
@@ -12,9 +13,9 @@ int
 fetchaddr(uint64 addr, uint64 *ip)
 {
   struct proc *p = myproc();
-  if(addr >= p->sz || addr+sizeof(uint64) > p->sz)
+  if(addr >= p->mm->sz || addr+sizeof(uint64) > p->mm->sz)
     return -1;
-  if(copyin(p->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
+  if(copyin(p->mm->pagetable, (char *)ip, addr, sizeof(*ip)) != 0)
     return -1;
   return 0;
 }
@@ -25,7 +26,7 @@ int
 fetchstr(uint64 addr, char *buf, int max)
 {
   struct proc *p = myproc();
-  int err = copyinstr(p->pagetable, buf, addr, max);
+  int err = copyinstr(p->mm->pagetable, buf, addr, max);
   if(err < 0)
     return err;
   return strlen(buf);
@@ -121,6 +122,30 @@ extern uint64 sys_join(void);
 extern uint64 sys_myfree(void);
 extern uint64 sys_myalloc(void);
 extern uint64 sys_getcpuid(void);
+extern uint64 sys_sched_setaffinity(void);
+extern uint64 sys_sched_getaffinity(void);
+extern uint64 sys_futex_wait(void);
+extern uint64 sys_futex_wake(void);
+extern uint64 sys_detach(void);
+extern uint64 sys_lockstat(void);
+extern uint64 sys_sem_trywait(void);
+extern uint64 sys_sem_timedwait(void);
+extern uint64 sys_semop(void);
+extern uint64 sys_mqopen(void);
+extern uint64 sys_mqstat(void);
+extern uint64 sys_msgsnd_batch(void);
+extern uint64 sys_msgrcv_batch(void);
+extern uint64 sys_msgsnd_pages(void);
+extern uint64 sys_msgrcv_pages(void);
+extern uint64 sys_shm_open(void);
+extern uint64 sys_shmat(void);
+extern uint64 sys_shmdt(void);
+extern uint64 sys_shm_unlink(void);
+extern uint64 sys_fcntl(void);
+extern uint64 sys_nswitch(void);
+extern uint64 sys_splice(void);
+extern uint64 sys_tee(void);
+extern uint64 sys_sendfile(void);
 
 static uint64 (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -161,6 +186,30 @@ static uint64 (*syscalls[])(void) = {
 [SYS_myalloc]     sys_myalloc,
 [SYS_myfree]      sys_myfree,
 [SYS_getcpuid]	  sys_getcpuid,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_futex_wait]  sys_futex_wait,
+[SYS_futex_wake]  sys_futex_wake,
+[SYS_detach]      sys_detach,
+[SYS_lockstat]    sys_lockstat,
+[SYS_sem_trywait] sys_sem_trywait,
+[SYS_sem_timedwait] sys_sem_timedwait,
+[SYS_semop]       sys_semop,
+[SYS_mqopen]      sys_mqopen,
+[SYS_mqstat]      sys_mqstat,
+[SYS_msgsnd_batch] sys_msgsnd_batch,
+[SYS_msgrcv_batch] sys_msgrcv_batch,
+[SYS_msgsnd_pages] sys_msgsnd_pages,
+[SYS_msgrcv_pages] sys_msgrcv_pages,
+[SYS_shm_open]    sys_shm_open,
+[SYS_shmat]       sys_shmat,
+[SYS_shmdt]       sys_shmdt,
+[SYS_shm_unlink]  sys_shm_unlink,
+[SYS_fcntl]       sys_fcntl,
+[SYS_nswitch]     sys_nswitch,
+[SYS_splice]      sys_splice,
+[SYS_tee]         sys_tee,
+[SYS_sendfile]    sys_sendfile,
 };
 
 void
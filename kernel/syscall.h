@@ -37,3 +37,27 @@
 #define SYS_myalloc         36
 #define SYS_myfree          37
 #define SYS_getcpuid	    38
+#define SYS_sched_setaffinity 39
+#define SYS_sched_getaffinity 40
+#define SYS_futex_wait      41
+#define SYS_futex_wake      42
+#define SYS_detach          43
+#define SYS_lockstat        44
+#define SYS_sem_trywait     45
+#define SYS_sem_timedwait   46
+#define SYS_semop           47
+#define SYS_mqopen          48
+#define SYS_mqstat          49
+#define SYS_msgsnd_batch    50
+#define SYS_msgrcv_batch    51
+#define SYS_msgsnd_pages    52
+#define SYS_msgrcv_pages    53
+#define SYS_shm_open        54
+#define SYS_shmat           55
+#define SYS_shmdt           56
+#define SYS_shm_unlink      57
+#define SYS_fcntl           58
+#define SYS_nswitch         59
+#define SYS_splice          60
+#define SYS_tee             61
+#define SYS_sendfile        62
@@ -5,8 +5,13 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "rwlock.h"
+#include "list.h"
 #include "proc.h"
-#include "sem.h"
+#include "mq.h"
+#include "shm.h"
+
+uint sh_var_for_sem_demo;
 
 uint64
 sys_exit(void)
@@ -47,8 +52,7 @@ sys_sbrk(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  addr = myproc()->sz;
-  if(growproc(n) < 0)
+  if(growproc(n, &addr) < 0)
     return -1;
   return addr;
 }
@@ -61,16 +65,18 @@ sys_sleep(void)
 
   if(argint(0, &n) < 0)
     return -1;
-  acquire(&tickslock);
+  // clockintr() bumps ticks holding tickslock.lk, and
+  // wakes sleepers after, so no wakeup can be missed.
+  acquire(&tickslock.lk);
   ticks0 = ticks;
   while(ticks - ticks0 < n){
     if(myproc()->killed){
-      release(&tickslock);
+      release(&tickslock.lk);
       return -1;
     }
-    sleep(&ticks, &tickslock);
+    sleep(&ticks, &tickslock.lk);
   }
-  release(&tickslock);
+  release(&tickslock.lk);
   return 0;
 }
 
@@ -89,14 +95,23 @@ sys_kill(void)
 uint64
 sys_uptime(void)
 {
-  uint xticks;
+  uint xticks, seq;
 
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
+  do {
+    seq = read_seqbegin(&tickslock);
+    xticks = ticks;
+  } while(read_seqretry(&tickslock, seq));
   return xticks;
 }
 
+// how many times this process has given up the CPU,
+// by sleeping, yielding or being preempted.
+uint64
+sys_nswitch(void)
+{
+  return myproc()->nswitch;
+}
+
 uint64
 sys_chpri(void)
 {
@@ -142,6 +157,119 @@ sys_shmrefcount(void)
   return shmrefcount(key);
 }
 
+uint64
+sys_shm_open(void)
+{
+  char name[SHMNAME];
+  int size, flags;
+
+  if(argstr(0, name, SHMNAME) < 0 || argint(1, &size) < 0 || argint(2, &flags) < 0)
+    return -1;
+  return shmopen(name, size, flags);
+}
+
+uint64
+sys_shmat(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return shmat(id);
+}
+
+uint64
+sys_shmdt(void)
+{
+  uint64 addr;
+
+  if(argaddr(0, &addr) < 0)
+    return -1;
+  return shmdt(addr);
+}
+
+uint64
+sys_shm_unlink(void)
+{
+  char name[SHMNAME];
+
+  if(argstr(0, name, SHMNAME) < 0)
+    return -1;
+  return shmunlink(name);
+}
+
+uint64
+sys_sem_create(void)
+{
+  int n;
+
+  if(argint(0, &n) < 0)
+    return -1;
+  return semcreate(n);
+}
+
+uint64
+sys_sem_free(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return semfree(id);
+}
+
+uint64
+sys_sem_p(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return semwait(id, 0, 0, 0);
+}
+
+uint64
+sys_sem_trywait(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return semwait(id, 1, 0, 0);
+}
+
+// wait at most n ticks.
+uint64
+sys_sem_timedwait(void)
+{
+  int id, n;
+
+  if(argint(0, &id) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return semwait(id, 0, 1, ticks + n);
+}
+
+uint64
+sys_sem_v(void)
+{
+  int id;
+
+  if(argint(0, &id) < 0)
+    return -1;
+  return sempost(id);
+}
+
+uint64
+sys_semop(void)
+{
+  uint64 ops;
+  int nops;
+
+  if(argaddr(0, &ops) < 0 || argint(1, &nops) < 0)
+    return -1;
+  return semop(ops, nops);
+}
+
 uint64
 sys_mqget(void)
 {
@@ -151,45 +279,132 @@ sys_mqget(void)
   return mqget(in);
 }
 
+uint64
+sys_mqopen(void)
+{
+  int key;
+  uint64 uattr;
+  struct mqattr attr;
+
+  if(argint(0, &key) < 0 || argaddr(1, &uattr) < 0)
+    return -1;
+  if(uattr == 0)
+    return mqopen(key, 0);
+  if(copyin(myproc()->mm->pagetable, (char*)&attr, uattr, sizeof(attr)) < 0)
+    return -1;
+  return mqopen(key, &attr);
+}
+
+uint64
+sys_mqstat(void)
+{
+  int mqid;
+  uint64 uattr;
+  struct mqattr attr;
+
+  if(argint(0, &mqid) < 0 || argaddr(1, &uattr) < 0)
+    return -1;
+  if(mqstat(mqid, &attr) < 0)
+    return -1;
+  if(copyout(myproc()->mm->pagetable, uattr, (char*)&attr, sizeof(attr)) < 0)
+    return -1;
+  return 0;
+}
+
 uint64
 sys_msgsnd(void)
 {
   int mqid;
-  int type,sz;
-  char * msg = "This is a empty massage";
+  int type,sz,flags,timeout;
+  uint64 msg;
   if(argint(0, &mqid) < 0 || argint(1, &type) < 0
-  || argint(2, &sz) < 0)
-    return -1;
-  if(argstr(3,msg,sz) < 0)
+  || argint(2, &sz) < 0 || argaddr(3, &msg) < 0
+  || argint(4, &flags) < 0 || argint(5, &timeout) < 0)
     return -1;
-  return msgsnd(mqid,type,sz, msg);
+  return msgsnd(mqid,type,sz, msg, flags, timeout);
 }
 
 uint64
 sys_msgrcv(void)
 {
   int a;
-  int b,c;
-  int d;
+  int b,c,flags,timeout;
+  uint64 d;
   if(argint(0, &a) < 0 || argint(1, &b) < 0
-  || argint(2, &c) < 0 || argint(3, &d) < 0)
+  || argint(2, &c) < 0 || argaddr(3, &d) < 0
+  || argint(4, &flags) < 0 || argint(5, &timeout) < 0)
+    return -1;
+  return msgrcv(a,b,c,d,flags,timeout);
+}
+
+uint64
+sys_msgsnd_batch(void)
+{
+  int mqid, n, flags, timeout;
+  uint64 v;
+
+  if(argint(0, &mqid) < 0 || argaddr(1, &v) < 0 || argint(2, &n) < 0
+  || argint(3, &flags) < 0 || argint(4, &timeout) < 0)
     return -1;
-  return msgrcv(a,b,c,d);
+  return msgsnd_batch(mqid, v, n, flags, timeout);
+}
+
+uint64
+sys_msgrcv_batch(void)
+{
+  int mqid, type, n, flags, timeout;
+  uint64 v;
+
+  if(argint(0, &mqid) < 0 || argint(1, &type) < 0 || argaddr(2, &v) < 0
+  || argint(3, &n) < 0 || argint(4, &flags) < 0 || argint(5, &timeout) < 0)
+    return -1;
+  return msgrcv_batch(mqid, type, v, n, flags, timeout);
+}
+
+uint64
+sys_msgsnd_pages(void)
+{
+  int mqid, type, len, flags, timeout;
+  uint64 addr;
+
+  if(argint(0, &mqid) < 0 || argint(1, &type) < 0 || argaddr(2, &addr) < 0
+  || argint(3, &len) < 0 || argint(4, &flags) < 0 || argint(5, &timeout) < 0)
+    return -1;
+  return msgsnd_pages(mqid, type, addr, len, flags, timeout);
+}
+
+uint64
+sys_msgrcv_pages(void)
+{
+  int mqid, type, flags, timeout;
+  uint64 ulen;
+
+  if(argint(0, &mqid) < 0 || argint(1, &type) < 0 || argaddr(2, &ulen) < 0
+  || argint(3, &flags) < 0 || argint(4, &timeout) < 0)
+    return 0;
+  return msgrcv_pages(mqid, type, ulen, flags, timeout);
 }
 
 uint64 sys_clone(void){
   uint64 a;
   uint64 b;
   uint64 c;
+  uint64 d;
   argaddr(0,&a);
   argaddr(1,&b);
   argaddr(2, &c);
+  argaddr(3, &d);
  
-  return (uint64)clone((void (*)(void *))a,(void*)b, (void *)c);
+  return (uint64)clone((void (*)(void *))a,(void*)b, (void *)c, (void *)d);
 }
 
 uint64 sys_join(void){
-  return (uint64)join();
+  int tid;
+  uint64 addr;
+
+  if(argint(0, &tid) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  return (uint64)join(tid, addr);
 }
 
 uint64 sys_myalloc(void){
@@ -209,3 +424,67 @@ uint64 sys_myfree(void){
 uint64 sys_getcpuid(void){
   return getcpuid();
 }
+
+uint64
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, (uint)mask);
+}
+
+uint64
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getaffinity(pid);
+}
+
+uint64
+sys_futex_wait(void)
+{
+  uint64 addr;
+  int val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &val) < 0)
+    return -1;
+  return futex_wait(addr, val);
+}
+
+uint64
+sys_futex_wake(void)
+{
+  uint64 addr;
+  int n;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &n) < 0)
+    return -1;
+  return futex_wake(addr, n);
+}
+
+uint64
+sys_detach(void)
+{
+  int tid;
+  uint64 addr;
+
+  if(argint(0, &tid) < 0 || argaddr(1, &addr) < 0)
+    return -1;
+  return detach(tid, addr);
+}
+
+uint64
+sys_lockstat(void)
+{
+  int reset;
+
+  if(argint(0, &reset) < 0)
+    return -1;
+  lockstat(reset);
+  return 0;
+}
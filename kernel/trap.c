@@ -3,10 +3,12 @@
 #include "memlayout.h"
 #include "loongarch.h"
 #include "spinlock.h"
+#include "rwlock.h"
+#include "list.h"
 #include "proc.h"
 #include "defs.h"
 
-struct spinlock tickslock;
+struct seqlock tickslock;   // ticks; sys_sleep() sleeps on tickslock.lk
 uint ticks;
 
 // in kernelvec.S, calls kerneltrap().
@@ -21,7 +23,7 @@ extern int devintr();
 void
 trapinit(void)
 {
-  initlock(&tickslock, "time");
+  initseqlock(&tickslock, "time");
   uint32 ecfg = ( 0U << CSR_ECFG_VS_SHIFT ) | HWI_VEC | TI_VEC;
   uint64 tcfg = 0x1000000UL | CSR_TCFG_EN | CSR_TCFG_PER;
   w_csr_ecfg(ecfg);
@@ -129,15 +131,13 @@ usertrapret(void)
   w_csr_era(p->trapframe->era);
 
   // tell uservec.S the user page table to switch to.
-  volatile uint64 pgdl = (uint64)(p->pagetable);
+  volatile uint64 pgdl = (uint64)(p->mm->pagetable);
 
   // jump to uservec.S at the top of memory, which 
   // switches to the user page table, restores user registers,
   // and switches to user mode with ertn.
-  if(p->pthread == 0)
-    userret(TRAPFRAME, pgdl);
-  else
-    userret(TRAPFRAME - PGSIZE, pgdl);
+  // Each thread's trapframe has its own slot.
+  userret(p->tfva, pgdl);
 }
 
 // interrupts and exceptions from kernel code go here via kernelvec,
@@ -179,10 +179,11 @@ machine_trap()
 void
 clockintr()
 {
-  acquire(&tickslock);
+  write_seqlock(&tickslock);
   ticks++;
+  write_sequnlock(&tickslock);
   wakeup(&ticks);
-  release(&tickslock);
+  timerwake(ticks);
 }
 
 // check if it's an external interrupt or software interrupt,
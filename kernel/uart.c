@@ -7,6 +7,7 @@
 #include "memlayout.h"
 #include "loongarch.h"
 #include "spinlock.h"
+#include "list.h"
 #include "proc.h"
 #include "defs.h"
 
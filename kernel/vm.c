@@ -22,7 +22,6 @@ vminit(void)//todo
 
   kpgtbl = (pagetable_t) kalloc();
   memset(kpgtbl, 0, PGSIZE);
-  proc_mapstacks(kpgtbl);
 
   w_csr_pgdl((uint64)kpgtbl);
   tlbinit();
@@ -64,6 +63,29 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
   return &pagetable[PX(0, va)];
 }
 
+// Like walk(), but stop one level up: return the address of
+// the entry that points at the last-level page table mapping
+// the 2MB around va.
+pte_t *
+walkpmd(pagetable_t pagetable, uint64 va, int alloc)
+{
+  if(va >= MAXVA)
+    panic("walkpmd");
+
+  for(int level = 3; level > 1; level--) {
+    pte_t *pte = &pagetable[PX(level, va)];
+    if(*pte & PTE_V) {
+      pagetable = (pagetable_t)(PTE2PA(*pte) | DMWIN_MASK);
+    } else {
+      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+        return 0;
+      memset(pagetable, 0, PGSIZE);
+      *pte = PA2PTE(pagetable) | PTE_V;
+    }
+  }
+  return &pagetable[PX(1, va)];
+}
+
 // Look up a virtual address, return the physical address,
 // or 0 if not mapped.
 // Can only be used to look up user pages.
@@ -0,0 +1,78 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Ping-pong a byte between a parent and child over two pipes,
+// first with both free to run anywhere, then with both pinned
+// to the cpu the parent started on, where the pipe buffers and
+// process state stay cache-warm.
+
+#define ROUNDS 2000
+
+int
+pingpong(void)
+{
+  int ping[2], pong[2];
+  int i, pid, t0;
+  char c = 'x';
+
+  if(pipe(ping) < 0 || pipe(pong) < 0){
+    printf("affinity: pipe failed\n");
+    exit(1);
+  }
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("affinity: fork failed\n");
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < ROUNDS; i++){
+      if(read(ping[0], &c, 1) != 1)
+        break;
+      write(pong[1], &c, 1);
+    }
+    exit(0);
+  }
+  for(i = 0; i < ROUNDS; i++){
+    write(ping[1], &c, 1);
+    if(read(pong[0], &c, 1) != 1){
+      printf("affinity: short read\n");
+      exit(1);
+    }
+  }
+  wait(0);
+  close(ping[0]);
+  close(ping[1]);
+  close(pong[0]);
+  close(pong[1]);
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int cpu, mask, t;
+
+  mask = sched_getaffinity(0);
+  t = pingpong();
+  printf("unpinned (mask %x): %d round trips in %d ticks\n", mask, ROUNDS, t);
+
+  cpu = getcpuid();
+  if(sched_setaffinity(0, 1 << cpu) < 0){
+    printf("affinity: sched_setaffinity failed\n");
+    exit(1);
+  }
+  if(sched_getaffinity(0) != (1 << cpu)){
+    printf("affinity: sched_getaffinity returned %x\n", sched_getaffinity(0));
+    exit(1);
+  }
+  t = pingpong();
+  printf("pinned to cpu %d: %d round trips in %d ticks\n", cpu, ROUNDS, t);
+
+  if(sched_setaffinity(0, 0) != -1){
+    printf("affinity: empty mask accepted\n");
+    exit(1);
+  }
+  exit(0);
+}
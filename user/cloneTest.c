@@ -11,8 +11,8 @@ int main(void)
 {
     uint64 arg[] = {1,2};
     void* stack = malloc(PGSIZE);   // allocate one page for user stack
-    clone(sayHello, stack,(void*)arg); // system call for kernel thread
+    clone(sayHello, stack,(void*)arg, 0); // system call for kernel thread
     printf("hello, I'm parenet \n");
-    join();
+    join(0, 0);
     return 0;
 }
\ No newline at end of file
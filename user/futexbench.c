@@ -0,0 +1,101 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/uthread.h"
+#include "user/umutex.h"
+
+// Contended-lock benchmark: the main thread and a cloned
+// thread each bump a shared counter N times under a lock,
+// once with a futex-based umutex and once with sem_p/sem_v,
+// which enter the kernel on every operation.
+
+#define N 20000
+
+struct umutex m;
+int semid;
+volatile int counter;
+
+void
+spin(void)
+{
+  // widen the critical section so that preemption
+  // inside it, and hence contention, is likely.
+  for(volatile int i = 0; i < 20; i++)
+    ;
+}
+
+void
+mutexloop(void)
+{
+  for(int i = 0; i < N; i++){
+    umutex_lock(&m);
+    counter++;
+    spin();
+    umutex_unlock(&m);
+  }
+}
+
+void
+semloop(void)
+{
+  for(int i = 0; i < N; i++){
+    sem_p(semid);
+    counter++;
+    spin();
+    sem_v(semid);
+  }
+}
+
+void
+mutexworker(void *arg)
+{
+  mutexloop();
+  exit(0);
+}
+
+void
+semworker(void *arg)
+{
+  semloop();
+  exit(0);
+}
+
+int
+run(char *name, void (*worker)(void*), void (*loop)(void))
+{
+  int t0, t;
+
+  counter = 0;
+  t0 = uptime();
+  if(thread_create(worker, 0) < 0){
+    printf("futexbench: thread_create failed\n");
+    exit(1);
+  }
+  loop();
+  thread_join();
+  t = uptime() - t0;
+  printf("%s: %d lock/unlock pairs in %d ticks\n", name, 2 * N, t);
+  if(counter != 2 * N){
+    printf("futexbench: %s lost updates, counter %d\n", name, counter);
+    exit(1);
+  }
+  return t;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int t0;
+
+  umutex_init(&m);
+  t0 = uptime();
+  mutexloop();
+  printf("umutex uncontended: %d pairs in %d ticks\n", N, uptime() - t0);
+
+  run("umutex", mutexworker, mutexloop);
+
+  semid = sem_create(1);
+  run("sem_p/sem_v", semworker, semloop);
+  sem_free(semid);
+  exit(0);
+}
@@ -0,0 +1,561 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/uthread.h"
+#include "user/umutex.h"
+#include "user/tls.h"
+#include "user/gthread.h"
+
+// M:N green threads.
+//
+// Tasks run on a few worker kernel threads made with
+// thread_create(). A kernel thread costs a proc and a
+// trapframe slot; a task costs a small struct and the part
+// of the stack it is actually using.
+//
+// Each worker owns one run stack, and every task it runs
+// executes there. Its size is set by gthread_stacksize();
+// below it lies a guard of canary words, checked whenever a
+// task parks and whenever it switches out. When a task switches out, the worker
+// copies the live part of the run stack, from the task's sp
+// to the top, into the task's save buffer, which grows as
+// the task's stack does; resuming copies it back. Since
+// pointers into a task's stack must stay valid, a task is
+// bound to the first worker that runs it. Tasks that have
+// not run yet wait on a shared queue any worker may take.
+//
+// Blocking calls go through a pool of I/O kernel threads:
+// the task hands the call over, the worker moves on to other
+// tasks, and the I/O thread requeues the task on its worker
+// when the call returns. The pool grows while every I/O
+// thread is blocked, so a reader cannot hold up the writer
+// it waits for. Data passes through a bounce buffer, since
+// the task's stack is not in place meanwhile.
+
+#define GSTACK   16384          // default bytes in a worker's run stack
+#define GMINSTACK 1024
+#define GGUARD     256          // bytes of canary below each run stack
+#define GMAXWORKER   8
+#define GNIO         2          // I/O kernel threads to start with
+#define GMAXIO      32
+#define GCANARY   0x67746872    // fills the guard
+
+struct gcontext {
+  uint64 ra;
+  uint64 sp;
+  uint64 s[9];                  // s0-s8
+  uint64 fp;
+};
+
+enum gstate { GREADY, GBLOCKED, GDONE };
+enum gop { GREAD, GWRITE, GSLEEP };
+
+struct gworker;
+
+struct gthread {
+  struct gcontext ctx;
+  enum gstate state;
+  int id;
+  void (*fn)(void*);
+  void *arg;
+  struct gworker *home;         // worker whose run stack holds us, once run
+  struct gthread *next;         // on a run queue or the I/O queue
+  char *save;                   // live stack while switched out
+  int savelen, savecap;
+  enum gop op;                  // blocking call handed to an I/O thread
+  int fd, n, ret;
+  char *buf;                    // bounce buffer
+};
+
+struct gqueue {
+  struct gthread *head, *tail;
+};
+
+struct gworker {
+  struct gcontext sched;        // worker's scheduler loop
+  struct gthread *cur;          // task running on this worker
+  char *stack;                  // guard, then run stack
+  struct gqueue runq;           // tasks bound to this worker, under g.lock
+  int tid;                      // its kernel thread, 0 for the caller's
+};
+
+void gswtch(struct gcontext *old, struct gcontext *new);
+
+static struct {
+  struct umutex lock;           // protects the queues and live
+  struct ucond cond;            // idle workers wait here
+  struct gqueue newq;           // tasks that have not run yet
+  int live;                     // tasks not yet finished
+  int stop;                     // gthread_run() failed; workers quit
+  int nextid;
+  int stacksize;                // run stack bytes, 0 for GSTACK
+  struct gworker worker[GMAXWORKER];
+  int nworker;
+} g;
+
+static struct {
+  struct umutex lock;
+  struct ucond cond;
+  struct gqueue q;              // tasks waiting for an I/O thread
+  int nthread;                  // I/O threads started
+  int tid[GMAXIO];              // their kernel threads
+  int nidle;                    // of which waiting for work
+  int done;
+} io;
+
+// umalloc keeps no lock of its own.
+static struct umutex memlock;
+
+static void iomain(void *arg);
+
+static int gkey = -1;           // TLS key: this kernel thread's worker
+
+static void*
+gmalloc(uint n)
+{
+  void *p;
+
+  umutex_lock(&memlock);
+  p = malloc(n);
+  umutex_unlock(&memlock);
+  return p;
+}
+
+static void
+gfree(void *p)
+{
+  if(p == 0)
+    return;
+  umutex_lock(&memlock);
+  free(p);
+  umutex_unlock(&memlock);
+}
+
+// thread_create() and its thread table use malloc(),
+// so they go under memlock too.
+static int
+newthread(void (*fn)(void*), void *arg)
+{
+  int r;
+
+  umutex_lock(&memlock);
+  r = thread_create(fn, arg);
+  umutex_unlock(&memlock);
+  return r;
+}
+
+static void
+qpush(struct gqueue *q, struct gthread *t)
+{
+  t->next = 0;
+  if(q->tail)
+    q->tail->next = t;
+  else
+    q->head = t;
+  q->tail = t;
+}
+
+static struct gthread*
+qpop(struct gqueue *q)
+{
+  struct gthread *t = q->head;
+
+  if(t){
+    q->head = t->next;
+    if(q->head == 0)
+      q->tail = 0;
+  }
+  return t;
+}
+
+static struct gworker*
+myworker(void)
+{
+  struct gworker **w;
+
+  if(gkey < 0 || (w = tls_get(gkey)) == 0)
+    return 0;
+  return *w;
+}
+
+// The ABI wants sp 16-byte aligned on entry to gstart().
+static char*
+stacktop(struct gworker *w)
+{
+  return (char*)((uint64)(w->stack + GGUARD + g.stacksize) & ~15UL);
+}
+
+static int
+guardok(struct gworker *w)
+{
+  for(uint *p = (uint*)w->stack; p < (uint*)(w->stack + GGUARD); p++)
+    if(*p != GCANARY)
+      return 0;
+  return 1;
+}
+
+static void
+overflow(struct gthread *t)
+{
+  printf("gthread: task %d overflowed its %d-byte stack\n", t->id, g.stacksize);
+  exit(1);
+}
+
+// Set the run stack size for the next gthread_run().
+// Returns 0, or -1 if n is too small.
+int
+gthread_stacksize(int n)
+{
+  if(n < GMINSTACK)
+    return -1;
+  g.stacksize = (n + 15) & ~15;
+  return 0;
+}
+
+// A task's first run starts here, on its worker's run stack.
+static void
+gstart(void)
+{
+  struct gthread *t = myworker()->cur;
+
+  t->fn(t->arg);
+  gthread_exit();
+}
+
+int
+gthread_spawn(void (*fn)(void*), void *arg)
+{
+  struct gthread *t;
+
+  if((t = gmalloc(sizeof(*t))) == 0)
+    return -1;
+  memset(t, 0, sizeof(*t));
+  t->fn = fn;
+  t->arg = arg;
+  t->state = GREADY;
+
+  umutex_lock(&g.lock);
+  t->id = ++g.nextid;
+  g.live++;
+  qpush(&g.newq, t);
+  ucond_signal(&g.cond);
+  umutex_unlock(&g.lock);
+  return t->id;
+}
+
+// Switch from the current task back to its worker.
+// Catch a task that has run into the guard here, while
+// its frames still say where it went wrong.
+static void
+park(enum gstate state)
+{
+  struct gworker *w = myworker();
+  struct gthread *t = w->cur;
+  char here;
+
+  if(&here < w->stack + GGUARD || !guardok(w))
+    overflow(t);
+  t->state = state;
+  gswtch(&t->ctx, &w->sched);
+}
+
+void
+gthread_yield(void)
+{
+  if(myworker() && myworker()->cur)
+    park(GREADY);
+}
+
+void
+gthread_exit(void)
+{
+  park(GDONE);
+  exit(1);    // not reached
+}
+
+int
+gthread_self(void)
+{
+  struct gworker *w = myworker();
+
+  return w && w->cur ? w->cur->id : 0;
+}
+
+// Copy the live part of the run stack into t's save buffer.
+static int
+savestack(struct gworker *w, struct gthread *t)
+{
+  int len = stacktop(w) - (char*)t->ctx.sp;
+
+  if(len > t->savecap){
+    gfree(t->save);
+    t->savecap = (len + 255) & ~255;
+    if((t->save = gmalloc(t->savecap)) == 0)
+      return -1;
+  }
+  memmove(t->save, (char*)t->ctx.sp, len);
+  t->savelen = len;
+  return 0;
+}
+
+// Next task for w: its own first, so bound tasks are not
+// starved by new ones. Caller holds g.lock.
+static struct gthread*
+pick(struct gworker *w)
+{
+  struct gthread *t;
+
+  if((t = qpop(&w->runq)) == 0)
+    t = qpop(&g.newq);
+  return t;
+}
+
+// Run tasks until none are left anywhere.
+static void
+schedule(struct gworker *w)
+{
+  struct gthread *t;
+  int tid;
+
+  for(;;){
+    umutex_lock(&g.lock);
+    while((t = pick(w)) == 0){
+      if(g.live == 0 || g.stop){
+        umutex_unlock(&g.lock);
+        return;
+      }
+      ucond_wait(&g.cond, &g.lock);
+    }
+    umutex_unlock(&g.lock);
+
+    if(t->home == 0){
+      t->home = w;
+      t->ctx.ra = (uint64)gstart;
+      t->ctx.sp = (uint64)stacktop(w);
+    } else {
+      memmove(stacktop(w) - t->savelen, t->save, t->savelen);
+    }
+    w->cur = t;
+    gswtch(&w->sched, &t->ctx);
+    w->cur = 0;
+
+    if(!guardok(w))
+      overflow(t);
+
+    switch(t->state){
+    case GDONE:
+      gfree(t->save);
+      gfree(t);
+      umutex_lock(&g.lock);
+      if(--g.live == 0)
+        ucond_broadcast(&g.cond);
+      umutex_unlock(&g.lock);
+      break;
+    case GREADY:
+      if(savestack(w, t) < 0){
+        printf("gthread: out of memory saving task %d\n", t->id);
+        exit(1);
+      }
+      umutex_lock(&g.lock);
+      qpush(&w->runq, t);
+      umutex_unlock(&g.lock);
+      break;
+    case GBLOCKED:
+      if(savestack(w, t) < 0){
+        printf("gthread: out of memory saving task %d\n", t->id);
+        exit(1);
+      }
+      umutex_lock(&io.lock);
+      qpush(&io.q, t);
+      if(io.nidle == 0 && io.nthread < GMAXIO && (tid = newthread(iomain, 0)) >= 0)
+        io.tid[io.nthread++] = tid;
+      else
+        ucond_signal(&io.cond);
+      umutex_unlock(&io.lock);
+      break;
+    }
+  }
+}
+
+static void
+setworker(struct gworker *w)
+{
+  *(struct gworker**)tls_get(gkey) = w;
+}
+
+static void
+workermain(void *arg)
+{
+  setworker(arg);
+  schedule(arg);
+  exit(0);
+}
+
+// Run blocking calls for parked tasks, then requeue them.
+static void
+iomain(void *arg)
+{
+  struct gthread *t;
+
+  for(;;){
+    umutex_lock(&io.lock);
+    while(io.q.head == 0 && !io.done){
+      io.nidle++;
+      ucond_wait(&io.cond, &io.lock);
+      io.nidle--;
+    }
+    t = qpop(&io.q);
+    umutex_unlock(&io.lock);
+    if(t == 0)
+      exit(0);
+
+    switch(t->op){
+    case GREAD:
+      t->ret = read(t->fd, t->buf, t->n);
+      break;
+    case GWRITE:
+      t->ret = write(t->fd, t->buf, t->n);
+      break;
+    case GSLEEP:
+      t->ret = sleep(t->n);
+      break;
+    }
+
+    umutex_lock(&g.lock);
+    t->state = GREADY;
+    qpush(&t->home->runq, t);
+    ucond_broadcast(&g.cond);
+    umutex_unlock(&g.lock);
+  }
+}
+
+// Hand a blocking call to an I/O thread and park until it is done.
+static int
+blockon(enum gop op, int fd, int n)
+{
+  struct gthread *t = myworker()->cur;
+
+  t->op = op;
+  t->fd = fd;
+  t->n = n;
+  park(GBLOCKED);
+  return t->ret;
+}
+
+int
+gthread_read(int fd, void *buf, int n)
+{
+  struct gthread *t;
+  int r;
+
+  if(myworker() == 0 || (t = myworker()->cur) == 0)
+    return read(fd, buf, n);
+  if((t->buf = gmalloc(n > 0 ? n : 1)) == 0)
+    return -1;
+  r = blockon(GREAD, fd, n);
+  if(r > 0)
+    memmove(buf, t->buf, r);
+  gfree(t->buf);
+  t->buf = 0;
+  return r;
+}
+
+int
+gthread_write(int fd, const void *buf, int n)
+{
+  struct gthread *t;
+  int r;
+
+  if(myworker() == 0 || (t = myworker()->cur) == 0)
+    return write(fd, buf, n);
+  if((t->buf = gmalloc(n > 0 ? n : 1)) == 0)
+    return -1;
+  memmove(t->buf, buf, n);
+  r = blockon(GWRITE, fd, n);
+  gfree(t->buf);
+  t->buf = 0;
+  return r;
+}
+
+int
+gthread_sleep(int ticks)
+{
+  if(myworker() == 0 || myworker()->cur == 0)
+    return sleep(ticks);
+  return blockon(GSLEEP, 0, ticks);
+}
+
+// Run spawned tasks, and any they spawn, on nworkers kernel
+// threads including the caller. Returns 0 once all are done,
+// or -1 if the threads could not be started.
+int
+gthread_run(int nworkers)
+{
+  int i, tid, nthread = 0, err = 0;
+  struct gworker *w;
+
+  if(nworkers < 1)
+    nworkers = 1;
+  if(nworkers > GMAXWORKER)
+    nworkers = GMAXWORKER;
+  if(gkey < 0 && (gkey = tls_alloc(sizeof(struct gworker*))) < 0)
+    return -1;
+  if(g.stacksize == 0)
+    g.stacksize = GSTACK;
+
+  for(i = 0; i < nworkers; i++){
+    w = &g.worker[i];
+    memset(w, 0, sizeof(*w));
+    if((w->stack = gmalloc(GGUARD + g.stacksize)) == 0)
+      return -1;
+    for(uint *p = (uint*)w->stack; p < (uint*)(w->stack + GGUARD); p++)
+      *p = GCANARY;
+  }
+  g.nworker = nworkers;
+  g.stop = 0;
+  io.nthread = 0;
+  io.nidle = 0;
+  io.done = 0;
+
+  for(i = 0; i < GNIO && !err; i++){
+    umutex_lock(&io.lock);
+    if((tid = newthread(iomain, 0)) < 0)
+      err = 1;
+    else
+      io.tid[io.nthread++] = tid;
+    umutex_unlock(&io.lock);
+  }
+  for(i = 1; i < nworkers && !err; i++){
+    if((g.worker[i].tid = newthread(workermain, &g.worker[i])) < 0)
+      err = 1;
+    else
+      nthread++;
+  }
+  if(err){
+    umutex_lock(&g.lock);
+    g.stop = 1;
+    ucond_broadcast(&g.cond);
+    umutex_unlock(&g.lock);
+  }
+
+  if(!err){
+    setworker(&g.worker[0]);
+    schedule(&g.worker[0]);
+    setworker(0);
+  }
+
+  // every task is done, so the I/O threads are idle
+  // and no thread will start another. Wait for our own
+  // threads by tid, leaving any of the caller's alone.
+  umutex_lock(&io.lock);
+  io.done = 1;
+  ucond_broadcast(&io.cond);
+  umutex_unlock(&io.lock);
+  for(i = 1; i <= nthread; i++)
+    thread_wait(g.worker[i].tid, 0);
+  for(i = 0; i < io.nthread; i++)
+    thread_wait(io.tid[i], 0);
+
+  for(i = 0; i < nworkers; i++)
+    gfree(g.worker[i].stack);
+  return err ? -1 : 0;
+}
@@ -0,0 +1,16 @@
+// Green threads: many cooperative tasks multiplexed onto
+// a few kernel threads. Spawn tasks, then call gthread_run(),
+// which returns once every task has finished.
+// gthread_read/write/sleep park only the calling task.
+// gthread_stacksize(), called before gthread_run(), sizes
+// the stack every task runs on; the default is 16KB.
+
+int gthread_spawn(void (*fn)(void*), void *arg);
+void gthread_yield(void);
+void gthread_exit(void) __attribute__((noreturn));
+int gthread_self(void);
+int gthread_stacksize(int n);
+int gthread_run(int nworkers);
+int gthread_read(int fd, void *buf, int n);
+int gthread_write(int fd, const void *buf, int n);
+int gthread_sleep(int ticks);
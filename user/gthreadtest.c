@@ -0,0 +1,105 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/gthread.h"
+
+// Green threads: many tasks taking turns on two workers,
+// then pairs of tasks talking over pipes, whose blocking
+// reads and writes park only the task that makes them.
+
+#define NTASK   500
+#define YIELDS  20
+#define NPAIR   16
+#define ROUNDS  50
+
+volatile int switches;
+volatile int bytes;
+int fds[NPAIR][2];
+
+void
+spinner(void *arg)
+{
+  for(int i = 0; i < YIELDS; i++){
+    __sync_fetch_and_add(&switches, 1);
+    gthread_yield();
+  }
+}
+
+void
+writer(void *arg)
+{
+  int *fd = arg;
+  char c = 'g';
+
+  for(int i = 0; i < ROUNDS; i++){
+    if(gthread_write(fd[1], &c, 1) != 1){
+      printf("gthreadtest: write failed\n");
+      exit(1);
+    }
+  }
+}
+
+void
+reader(void *arg)
+{
+  int *fd = arg;
+  char c;
+
+  // each kernel thread has its own copy of the fd table,
+  // so count bytes rather than wait for end of file.
+  for(int i = 0; i < ROUNDS; i++){
+    if(gthread_read(fd[0], &c, 1) != 1){
+      printf("gthreadtest: read failed\n");
+      exit(1);
+    }
+    __sync_fetch_and_add(&bytes, 1);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, t0;
+
+  for(i = 0; i < NTASK; i++){
+    if(gthread_spawn(spinner, 0) < 0){
+      printf("gthreadtest: spawn %d failed\n", i);
+      exit(1);
+    }
+  }
+  t0 = uptime();
+  if(gthread_run(2) < 0){
+    printf("gthreadtest: gthread_run failed\n");
+    exit(1);
+  }
+  printf("%d tasks, %d yields in %d ticks\n", NTASK, switches, uptime() - t0);
+  if(switches != NTASK * YIELDS){
+    printf("gthreadtest: expected %d yields\n", NTASK * YIELDS);
+    exit(1);
+  }
+
+  for(i = 0; i < NPAIR; i++){
+    if(pipe(fds[i]) < 0){
+      printf("gthreadtest: pipe failed\n");
+      exit(1);
+    }
+    // readers first, so they block before any data arrives.
+    gthread_spawn(reader, fds[i]);
+    gthread_spawn(writer, fds[i]);
+  }
+  t0 = uptime();
+  if(gthread_run(2) < 0){
+    printf("gthreadtest: gthread_run failed\n");
+    exit(1);
+  }
+  printf("%d pipe pairs, %d bytes in %d ticks\n", NPAIR, bytes, uptime() - t0);
+  for(i = 0; i < NPAIR; i++){
+    close(fds[i][0]);
+    close(fds[i][1]);
+  }
+  if(bytes != NPAIR * ROUNDS){
+    printf("gthreadtest: expected %d bytes\n", NPAIR * ROUNDS);
+    exit(1);
+  }
+  exit(0);
+}
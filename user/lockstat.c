@@ -0,0 +1,22 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+
+// Print the kernel's per-class spinlock and rwlock statistics.
+// With -r, clear them afterwards, so that a second run
+// shows only what happened in between.
+
+int
+main(int argc, char *argv[])
+{
+  int reset = 0;
+
+  if(argc > 1 && strcmp(argv[1], "-r") == 0)
+    reset = 1;
+  else if(argc > 1){
+    fprintf(2, "usage: lockstat [-r]\n");
+    exit(1);
+  }
+  lockstat(reset);
+  exit(0);
+}
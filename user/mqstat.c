@@ -0,0 +1,23 @@
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/mq.h"
+#include "user/user.h"
+
+// List the message queues in use: capacity, current depth
+// and high-water marks.
+
+int
+main(int argc, char *argv[])
+{
+  struct mqattr a;
+  int id;
+
+  printf("id key capacity msgsize maxmsg msgs bytes hwmsgs hwbytes\n");
+  for(id = 0; id < MQMAX; id++){
+    if(mqstat(id, &a) < 0)
+      continue;
+    printf("%d %d %d %d %d %d %d %d %d\n", id, a.key, a.maxbytes, a.msgsize,
+           a.maxmsg, a.curmsgs, a.curbytes, a.hwmsgs, a.hwbytes);
+  }
+  exit(0);
+}
@@ -5,6 +5,7 @@
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
 #include "kernel/syscall.h"
+#include "kernel/mq.h"
 // #include "traps.h"
 #include "kernel/memlayout.h"
  
@@ -24,41 +25,260 @@ void msg_test()
     s1.type = 1;
     s1.dataaddr = "This is the first message!\n";
  
-    msgsnd(mqid, s1.type, 28, s1.dataaddr); //发送消息1
+    msgsnd(mqid, s1.type, 28, s1.dataaddr, 0, 0); //发送消息1
  
     s1.type = 2;
     s1.dataaddr = "Hello, another message comes!\n";
-    msgsnd(mqid, s1.type, 31, s1.dataaddr); //发送消息2
+    msgsnd(mqid, s1.type, 31, s1.dataaddr, 0, 0); //发送消息2
     s1.type = 3;
     s1.dataaddr = "This is the third message, and this message has great many characters!\n";
-    msgsnd(mqid, s1.type, 72, s1.dataaddr); //发送消息3
+    msgsnd(mqid, s1.type, 72, s1.dataaddr, 0, 0); //发送消息3
  
     printf("all messages have been sent.\n");
   } else if (pid >0)          //以下是父进程
   {
  
     sleep(10);      // sleep保证子进程消息写入
-    g.dataaddr = malloc(70);
+    g.dataaddr = malloc(72);
     g.type = 2;
-    msgrcv(mqid,g.type, 31, (uint64)g.dataaddr);    //读入消息2
+    msgrcv(mqid,g.type, 31, (uint64)g.dataaddr, 0, 0);    //读入消息2
     printf("receive the %dth message: %s\n", 2, g.dataaddr);
     g.type = 1;
-    msgrcv(mqid,g.type, 28, (uint64)g.dataaddr);    //读入消息1
+    msgrcv(mqid,g.type, 28, (uint64)g.dataaddr, 0, 0);    //读入消息1
     printf("receive the %dth message: %s\n", 1, g.dataaddr);
     g.type = 3;
-    msgrcv(mqid,g.type, 70, (uint64)g.dataaddr);    //读入消息3
+    msgrcv(mqid,g.type, 72, (uint64)g.dataaddr, 0, 0);    //读入消息3
     printf("receive the %dth message: %s\n", 3, g.dataaddr);
  
     wait(0);
  
   }
-  exit(0);
+}
+
+// 吞吐量测试：每轮先发送 NQUEUED 条消息（类型 1..NTYPE 轮流），
+// 再按类型从大到小全部接收，队列里始终积压着很多消息。
+// 队列容量 MQMAXPAGES 页，最后报告最高水位。
+#define NQUEUED 512
+#define NTYPE   8
+#define ROUNDS  25
+
+// 同样的负载，每次系统调用收发最多 MSGBATCH 条
+void msg_bench_batch(int mqid)
+{
+  struct msgvec v[MSGBATCH];
+  int data[MSGBATCH][6];
+  int i, j, k, n, r, t, t0;
+
+  t0 = uptime();
+  for(r = 0; r < ROUNDS; r++){
+    for(i = 0; i < NQUEUED; i += n){
+      n = NQUEUED - i < MSGBATCH ? NQUEUED - i : MSGBATCH;
+      for(j = 0; j < n; j++){
+        data[j][0] = i + j;
+        v[j].type = (i + j) % NTYPE + 1;
+        v[j].size = sizeof(data[j]);
+        v[j].data = (char *)data[j];
+      }
+      if(msgsnd_batch(mqid, v, n, 0, 0) != n){
+        printf("msg_bench: msgsnd_batch failed\n");
+        exit(1);
+      }
+    }
+    for(t = NTYPE; t >= 1; t--){
+      for(i = t - 1; i < NQUEUED; i += n * NTYPE){
+        for(j = 0; j < MSGBATCH; j++){
+          v[j].size = sizeof(data[j]);
+          v[j].data = (char *)data[j];
+        }
+        if((n = msgrcv_batch(mqid, t, v, MSGBATCH, MSG_NOWAIT, 0)) <= 0){
+          printf("msg_bench: msgrcv_batch type %d failed\n", t);
+          exit(1);
+        }
+        for(k = 0; k < n; k++){
+          if(v[k].type != t || v[k].size != sizeof(data[k])
+          || data[k][0] != i + k * NTYPE){
+            printf("msg_bench: batch type %d got message %d, want %d\n",
+                   t, data[k][0], i + k * NTYPE);
+            exit(1);
+          }
+        }
+      }
+    }
+  }
+  printf("msg_bench: batches of %d: %d messages in %d ticks\n",
+         MSGBATCH, ROUNDS * NQUEUED, uptime() - t0);
+}
+
+// 接收方式与不等待、超时
+void msg_modes(int mqid)
+{
+  static int types[] = { 5, 3, 7, 2 };
+  static int want[] = { 0, 5,  -4, 2,  -4, 3,  0, 7 };
+  int buf[6], i, t0;
+
+  for(i = 0; i < 4; i++){
+    buf[0] = types[i];
+    if(msgsnd(mqid, types[i], sizeof(buf), (char *)buf, MSG_NOWAIT, 0) < 0){
+      printf("msg_modes: msgsnd failed\n");
+      exit(1);
+    }
+  }
+  if(msgsnd(mqid, 0, sizeof(buf), (char *)buf, MSG_NOWAIT, 0) != -1){
+    printf("msg_modes: type 0 sent\n");
+    exit(1);
+  }
+  for(i = 0; i < 8; i += 2){
+    buf[0] = -1;
+    if(msgrcv(mqid, want[i], sizeof(buf), (uint64)buf, MSG_NOWAIT, 0) != sizeof(buf)
+    || buf[0] != want[i+1]){
+      printf("msg_modes: type %d got %d, want %d\n", want[i], buf[0], want[i+1]);
+      exit(1);
+    }
+  }
+  if(msgrcv(mqid, 0, sizeof(buf), (uint64)buf, MSG_NOWAIT, 0) != -1){
+    printf("msg_modes: MSG_NOWAIT on an empty queue\n");
+    exit(1);
+  }
+  t0 = uptime();
+  if(msgrcv(mqid, 0, sizeof(buf), (uint64)buf, 0, 5) != -1 || uptime() - t0 < 5){
+    printf("msg_modes: timeout after %d ticks\n", uptime() - t0);
+    exit(1);
+  }
+  printf("msg_modes: ok\n");
+}
+
+void msg_bench()
+{
+  struct mqattr attr;
+  int mqid, i, r, t, t0, buf[6];
+
+  memset(&attr, 0, sizeof(attr));
+  attr.maxbytes = MQMAXPAGES * 4096;
+  attr.msgsize = sizeof(buf);
+  if((mqid = mqopen(456, &attr)) < 0){
+    printf("msg_bench: mqopen failed\n");
+    exit(1);
+  }
+  if(msgsnd(mqid, 1, sizeof(buf) + 1, (char *)buf, 0, 0) != -1){
+    printf("msg_bench: message over msgsize accepted\n");
+    exit(1);
+  }
+  msg_modes(mqid);
+
+  t0 = uptime();
+  for(r = 0; r < ROUNDS; r++){
+    for(i = 0; i < NQUEUED; i++){
+      buf[0] = i;
+      if(msgsnd(mqid, i % NTYPE + 1, sizeof(buf), (char *)buf, 0, 0) < 0){
+        printf("msg_bench: msgsnd failed\n");
+        exit(1);
+      }
+    }
+    for(t = NTYPE; t >= 1; t--){
+      for(i = t - 1; i < NQUEUED; i += NTYPE){
+        if(msgrcv(mqid, t, sizeof(buf), (uint64)buf, 0, 0) != sizeof(buf) || buf[0] != i){
+          printf("msg_bench: type %d got message %d, want %d\n", t, buf[0], i);
+          exit(1);
+        }
+      }
+    }
+  }
+  printf("msg_bench: %d messages sent and received, %d queued, in %d ticks\n",
+         ROUNDS * NQUEUED, NQUEUED, uptime() - t0);
+  msg_bench_batch(mqid);
+  if(mqstat(mqid, &attr) < 0 || attr.curmsgs != 0 || attr.hwmsgs != NQUEUED){
+    printf("msg_bench: mqstat: %d queued, high-water %d\n", attr.curmsgs, attr.hwmsgs);
+    exit(1);
+  }
+  printf("msg_bench: high-water %d messages, %d bytes of %d\n",
+         attr.hwmsgs, attr.hwbytes, attr.maxbytes);
 }
  
+// 整页传递：一条 NPG 页、含 0 字节的记录反复收发，先拷贝，
+// 再用 msgsnd_pages()/msgrcv_pages() 只移交页
+#define NPG     8
+#define XROUNDS 200
+
+int check(char *p, int len)
+{
+  for(int i = 0; i < len; i++)
+    if(p[i] != (char)(i * 7))
+      return -1;
+  return 0;
+}
+
+void msg_pages()
+{
+  struct mqattr attr;
+  int mqid, i, r, n, len, t0, tc;
+  char *buf, *p;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.maxbytes = MQMAXPAGES * 4096;
+  attr.msgsize = NPG * 4096;
+  len = NPG * 4096 - 5;
+  if((mqid = mqopen(789, &attr)) < 0 || (p = malloc(len)) == 0
+  || (buf = (char *)myalloc(NPG * 4096)) == 0){
+    printf("msg_pages: setup failed\n");
+    exit(1);
+  }
+  for(i = 0; i < len; i++)
+    buf[i] = i * 7;
+  if(msgsnd_pages(mqid, 1, p, len, MSG_NOWAIT, 0) != -1){
+    printf("msg_pages: sent pages not from myalloc()\n");
+    exit(1);
+  }
+
+  t0 = uptime();
+  for(r = 0; r < XROUNDS; r++){
+    if(msgsnd(mqid, 1, len, buf, 0, 0) < 0
+    || msgrcv(mqid, 1, len, (uint64)buf, 0, 0) != len){
+      printf("msg_pages: copy round %d failed\n", r);
+      exit(1);
+    }
+  }
+  tc = uptime() - t0;
+
+  t0 = uptime();
+  for(r = 0; r < XROUNDS; r++){
+    if(msgsnd_pages(mqid, 1, buf, len, 0, 0) < 0
+    || (buf = msgrcv_pages(mqid, 1, &n, 0, 0)) == 0 || n != len){
+      printf("msg_pages: page round %d failed\n", r);
+      exit(1);
+    }
+  }
+  printf("msg_pages: %d records of %d bytes: copied in %d ticks, pages moved in %d\n",
+         XROUNDS, len, tc, uptime() - t0);
+  if(check(buf, len) < 0){
+    printf("msg_pages: record corrupted\n");
+    exit(1);
+  }
+
+  // 两种消息都可以用另一种方式接收
+  if(msgsnd_pages(mqid, 2, buf, len, 0, 0) < 0
+  || msgrcv(mqid, 2, len, (uint64)p, 0, 0) != len || check(p, len) < 0){
+    printf("msg_pages: page message copied out wrong\n");
+    exit(1);
+  }
+  if(msgsnd(mqid, 3, len, p, 0, 0) < 0
+  || (buf = msgrcv_pages(mqid, 3, &n, 0, 0)) == 0 || n != len || check(buf, len) < 0){
+    printf("msg_pages: copied message mapped wrong\n");
+    exit(1);
+  }
+  myfree((uint64)buf);
+  free(p);
+}
+
 int
 main(int argc, char *argv[])
 {
     // printf(1, "消息队列测试\n");
-    msg_test();
+    if(fork() == 0){
+      msg_test();
+      exit(0);
+    }
+    wait(0);
+    msg_bench();
+    msg_pages();
     exit(0);
 }
\ No newline at end of file
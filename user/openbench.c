@@ -0,0 +1,81 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// Path lookup throughput: 1, 2 and 4 processes each open,
+// close and stat the same files in a loop. Every lookup
+// goes through iget() and every open through the file
+// table, so on several cpus this measures how well those
+// read paths run side by side.
+
+#define N      2000
+#define NFILES 4
+
+char *names[NFILES] = { "ob0", "ob1", "ob2", "ob3" };
+
+void
+loop(int id)
+{
+  struct stat st;
+  char *name;
+  int i, fd;
+
+  for(i = 0; i < N; i++){
+    name = names[(i + id) % NFILES];
+    if((fd = open(name, O_RDONLY)) < 0){
+      printf("openbench: open %s failed\n", name);
+      exit(1);
+    }
+    close(fd);
+    if(stat(name, &st) < 0 || st.type != T_FILE){
+      printf("openbench: stat %s failed\n", name);
+      exit(1);
+    }
+  }
+}
+
+void
+run(int nproc)
+{
+  int i, t0, t, status, pid;
+
+  t0 = uptime();
+  for(i = 0; i < nproc; i++){
+    pid = fork();
+    if(pid < 0){
+      printf("openbench: fork failed\n");
+      exit(1);
+    }
+    if(pid == 0){
+      loop(i);
+      exit(0);
+    }
+  }
+  for(i = 0; i < nproc; i++){
+    wait(&status);
+    if(status != 0)
+      exit(1);
+  }
+  t = uptime() - t0;
+  printf("%d procs: %d open+stat in %d ticks\n", nproc, nproc * N, t);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, fd;
+
+  for(i = 0; i < NFILES; i++){
+    if((fd = open(names[i], O_CREATE | O_RDWR)) < 0){
+      printf("openbench: create %s failed\n", names[i]);
+      exit(1);
+    }
+    close(fd);
+  }
+  for(i = 1; i <= 4; i *= 2)
+    run(i);
+  for(i = 0; i < NFILES; i++)
+    unlink(names[i]);
+  exit(0);
+}
@@ -0,0 +1,68 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// Context switches per MiB piped, for several pipe sizes.
+// A child writes TOTAL bytes in CHUNK-byte writes, the parent
+// reads them, and each counts how often it gave up the CPU.
+
+#define TOTAL (8*1024*1024)
+#define CHUNK 4096
+#define MB    (1024*1024)
+
+char buf[CHUNK];
+
+void
+run(int size)
+{
+  int fds[2], res[2], got, n, t0, sw, wsw;
+
+  if(pipe(fds) < 0 || pipe(res) < 0){
+    printf("pipebench: pipe failed\n");
+    exit(1);
+  }
+  if(size && fcntl(fds[1], F_SETPIPE_SZ, size) != size){
+    printf("pipebench: F_SETPIPE_SZ %d failed\n", size);
+    exit(1);
+  }
+  size = fcntl(fds[0], F_GETPIPE_SZ, 0);
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    sw = nswitch();
+    for(n = 0; n < TOTAL; n += CHUNK)
+      write(fds[1], buf, CHUNK);
+    close(fds[1]);
+    sw = nswitch() - sw;
+    write(res[1], &sw, sizeof(sw));
+    exit(0);
+  }
+  close(fds[1]);
+  sw = nswitch();
+  got = 0;
+  while((n = read(fds[0], buf, CHUNK)) > 0)
+    got += n;
+  sw = nswitch() - sw;
+  close(fds[0]);
+  read(res[0], &wsw, sizeof(wsw));
+  close(res[0]);
+  close(res[1]);
+  wait(0);
+  if(got != TOTAL){
+    printf("pipebench: read %d bytes of %d\n", got, TOTAL);
+    exit(1);
+  }
+  printf("%d KB pipe: %d ticks, switches per MiB: reader %d, writer %d\n",
+         size / 1024, uptime() - t0, sw / (TOTAL / MB), wsw / (TOTAL / MB));
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int sizes[] = { 4096, 0, 64*1024, 256*1024 };
+
+  for(int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    run(sizes[i]);
+  exit(0);
+}
@@ -0,0 +1,129 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/mq.h"
+#include "user/user.h"
+#include "user/shmring.h"
+
+// IPC benchmark. A forked child sends NMSG messages of 64 bytes,
+// then of 4KB, to its parent through a pipe, a message queue,
+// a one-to-one shared memory ring, and a ring shared by two
+// senders and two receivers. Each line gives the ticks taken.
+
+#define NMSG   20000
+#define MAXMSG 4096
+#define NSLOT  64
+#define MQKEY  0x7262   // "rb"
+
+char buf[MAXMSG];
+
+int
+readall(int fd, char *p, int n)
+{
+  int r, got = 0;
+
+  while(got < n && (r = read(fd, p + got, n - got)) > 0)
+    got += r;
+  return got;
+}
+
+int
+bypipe(int size)
+{
+  int fds[2], i, t0;
+
+  if(pipe(fds) < 0)
+    return -1;
+  t0 = uptime();
+  if(fork() == 0){
+    close(fds[0]);
+    for(i = 0; i < NMSG; i++)
+      write(fds[1], buf, size);
+    exit(0);
+  }
+  close(fds[1]);
+  for(i = 0; i < NMSG; i++)
+    if(readall(fds[0], buf, size) != size)
+      return -1;
+  close(fds[0]);
+  wait(0);
+  return uptime() - t0;
+}
+
+int
+bymq(int size)
+{
+  struct mqattr attr;
+  int mqid, i, t0;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.maxbytes = MQMAXPAGES * 4096;
+  attr.msgsize = MAXMSG;
+  if((mqid = mqopen(MQKEY, &attr)) < 0)
+    return -1;
+  t0 = uptime();
+  if(fork() == 0){
+    mqid = mqopen(MQKEY, &attr);
+    for(i = 0; i < NMSG; i++)
+      msgsnd(mqid, 1, size, buf, 0, 0);
+    exit(0);
+  }
+  for(i = 0; i < NMSG; i++)
+    if(msgrcv(mqid, 1, size, (uint64)buf, 0, 0) != size)
+      return -1;
+  wait(0);
+  return uptime() - t0;
+}
+
+// nsend children send NMSG messages between them; the parent
+// and nrecv-1 more children receive them.
+int
+byring(int size, int nsend, int nrecv)
+{
+  struct shmring *r;
+  int i, t0, n = NMSG / nsend;
+
+  shmring_unlink("ringbench");
+  r = shmring_create("ringbench", MAXMSG, NSLOT, nsend > 1 || nrecv > 1 ? SHMRING_MPMC : 0);
+  if(r == 0)
+    return -1;
+  t0 = uptime();
+  for(i = 0; i < nsend; i++){
+    if(fork() == 0){
+      while(n-- > 0)
+        shmring_send(r, buf, size, 0);
+      exit(0);
+    }
+  }
+  n = NMSG / nsend * nsend / nrecv;
+  for(i = 1; i < nrecv; i++){
+    if(fork() == 0){
+      while(n-- > 0)
+        shmring_recv(r, buf, size, 0);
+      exit(0);
+    }
+  }
+  while(n-- > 0)
+    if(shmring_recv(r, buf, size, 0) != size)
+      return -1;
+  for(i = 1; i < nsend + nrecv; i++)
+    wait(0);
+  shmring_close(r);
+  shmring_unlink("ringbench");
+  return uptime() - t0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int sizes[] = { 64, MAXMSG };
+
+  for(int i = 0; i < 2; i++){
+    int size = sizes[i];
+    printf("%d messages of %d bytes:\n", NMSG, size);
+    printf("  pipe          %d ticks\n", bypipe(size));
+    printf("  message queue %d ticks\n", bymq(size));
+    printf("  ring 1:1      %d ticks\n", byring(size, 1, 1));
+    printf("  ring 2:2      %d ticks\n", byring(size, 2, 2));
+  }
+  exit(0);
+}
@@ -0,0 +1,105 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/sem.h"
+#include "user/user.h"
+#include "user/uthread.h"
+
+// Semaphore handoff benchmark. Two threads first pass a token
+// back and forth through a pair of semaphores, which times one
+// sem_v() waking a sleeping sem_p(). Then a producer and a
+// consumer move items through a bounded buffer; the producer
+// takes a free slot and the buffer lock in one semop().
+
+#define ROUNDS 5000
+#define ITEMS  20000
+#define NSLOT  8
+
+int ping, pong;
+int empty, full, mutex;
+int buf[NSLOT];
+int head, tail;
+
+void
+ponger(void *arg)
+{
+  for(int i = 0; i < ROUNDS; i++){
+    sem_p(ping);
+    sem_v(pong);
+  }
+  exit(0);
+}
+
+void
+producer(void *arg)
+{
+  struct sembuf take[2], give[2];
+
+  take[0].sem_id = empty;
+  take[0].sem_op = -1;
+  take[0].sem_flg = 0;
+  take[1].sem_id = mutex;
+  take[1].sem_op = -1;
+  take[1].sem_flg = 0;
+  give[0].sem_id = mutex;
+  give[0].sem_op = 1;
+  give[0].sem_flg = 0;
+  give[1].sem_id = full;
+  give[1].sem_op = 1;
+  give[1].sem_flg = 0;
+  for(int i = 1; i <= ITEMS; i++){
+    semop(take, 2);
+    buf[tail++ % NSLOT] = i;
+    semop(give, 2);
+  }
+  exit(0);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, t0;
+  long sum;
+
+  ping = sem_create(0);
+  pong = sem_create(0);
+  t0 = uptime();
+  if(thread_create(ponger, 0) < 0){
+    printf("sembench: thread_create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < ROUNDS; i++){
+    sem_v(ping);
+    sem_p(pong);
+  }
+  thread_join();
+  printf("ping-pong: %d round trips in %d ticks\n", ROUNDS, uptime() - t0);
+  sem_free(ping);
+  sem_free(pong);
+
+  empty = sem_create(NSLOT);
+  full = sem_create(0);
+  mutex = sem_create(1);
+  sum = 0;
+  t0 = uptime();
+  if(thread_create(producer, 0) < 0){
+    printf("sembench: thread_create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < ITEMS; i++){
+    sem_p(full);
+    sem_p(mutex);
+    sum += buf[head++ % NSLOT];
+    sem_v(mutex);
+    sem_v(empty);
+  }
+  thread_join();
+  printf("bounded buffer: %d items in %d ticks\n", ITEMS, uptime() - t0);
+  if(sum != (long)ITEMS * (ITEMS + 1) / 2){
+    printf("sembench: lost items, sum %l\n", sum);
+    exit(1);
+  }
+  sem_free(empty);
+  sem_free(full);
+  sem_free(mutex);
+  exit(0);
+}
@@ -0,0 +1,88 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/shm.h"
+#include "user/user.h"
+
+// Shared memory benchmark. A parent fills a table of several MB
+// in a named object, forked workers each attach it and sum a
+// slice, and the parent checks the total. Then one process
+// attaches and detaches the object over and over, which costs
+// one page-directory entry per 2MB however many pages it holds,
+// against myalloc() of the same size for comparison.
+
+#define MB      (1024*1024)
+#define TABSIZE (8*MB)
+#define NWORKER 4
+#define ROUNDS  200
+
+int
+main(int argc, char *argv[])
+{
+  int id, i, w, t0, n = TABSIZE / sizeof(int);
+  int *tab, *part;
+  long sum, want;
+  char *p;
+
+  shm_unlink("shmbench");
+  if((id = shm_open("shmbench", TABSIZE + 4096, SHM_CREAT|SHM_EXCL)) < 0){
+    printf("shmbench: shm_open failed\n");
+    exit(1);
+  }
+  if((tab = shmat(id)) == (int*)-1){
+    printf("shmbench: shmat failed\n");
+    exit(1);
+  }
+  part = tab + n;            // one slot per worker, in the last page
+  want = 0;
+  for(i = 0; i < n; i++){
+    tab[i] = i % 1000;
+    want += i % 1000;
+  }
+
+  t0 = uptime();
+  for(w = 0; w < NWORKER; w++){
+    if(fork() == 0){
+      int *t = shmat(id);    // a second attachment, besides the inherited one
+      if(t == (int*)-1)
+        exit(1);
+      sum = 0;
+      for(i = w * (n / NWORKER); i < (w + 1) * (n / NWORKER); i++)
+        sum += t[i];
+      t[n + w] = sum;
+      exit(0);
+    }
+  }
+  for(w = 0; w < NWORKER; w++)
+    wait(0);
+  sum = 0;
+  for(w = 0; w < NWORKER; w++)
+    sum += part[w];
+  printf("sum: %d workers over %d MB in %d ticks, %s\n",
+         NWORKER, TABSIZE / MB, uptime() - t0, sum == want ? "ok" : "WRONG");
+
+  t0 = uptime();
+  for(i = 0; i < ROUNDS; i++){
+    if((p = shmat(id)) == (char*)-1){
+      printf("shmbench: shmat failed\n");
+      exit(1);
+    }
+    p[i * 4096] = 1;
+    shmdt(p);
+  }
+  printf("shmat+shmdt %d MB: %d rounds in %d ticks\n", TABSIZE / MB, ROUNDS, uptime() - t0);
+
+  t0 = uptime();
+  for(i = 0; i < ROUNDS; i++){
+    if((p = (char*)myalloc(TABSIZE)) == 0){
+      printf("shmbench: myalloc failed\n");
+      exit(1);
+    }
+    p[i * 4096] = 1;
+    myfree((uint64)p);
+  }
+  printf("myalloc+myfree %d MB: %d rounds in %d ticks\n", TABSIZE / MB, ROUNDS, uptime() - t0);
+
+  shmdt(tab);
+  shm_unlink("shmbench");
+  exit(0);
+}
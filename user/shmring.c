@@ -0,0 +1,242 @@
+#include "kernel/types.h"
+#include "kernel/shm.h"
+#include "user/user.h"
+#include "user/shmring.h"
+
+// Bounded message rings in shared memory.
+//
+// The ring is an array of slots, a power of two of them, each
+// carrying a sequence number. Slot i is free for the sender at
+// position pos when its sequence is pos, and full for the
+// receiver when it is pos + 1; the receiver hands it back for
+// the next lap by setting it to pos + nslot. Senders claim a
+// position by advancing tail, receivers by advancing head.
+// With one sender and one receiver each owns its index and a
+// plain store does; SHMRING_MPMC claims with compare-and-swap.
+//
+// A side that finds the ring empty or full spins a little,
+// then sleeps on a futex. The futex is keyed by physical
+// address, so it works across processes. The other side only
+// calls futex_wake() when it sees someone sleeping.
+//
+// After Vyukov, "Bounded MPMC queue", 1024cores.net.
+
+#define MAGIC    0x52494e47       // "RING"
+#define LINE     64               // keep the indexes on their own cache lines
+#define SPINS    100
+#define SLOTHDR  16
+
+struct shmring {
+  volatile int magic;             // set last by shmring_create()
+  int flags;
+  int msgsize;
+  int nslot;                      // a power of two
+  int stride;                     // bytes per slot
+  char pad0[LINE - 5*sizeof(int)];
+  volatile long tail;             // next position to send
+  volatile int nonfull;           // bumped when a slot is freed and a sender sleeps
+  volatile int wsleep;            // senders asleep
+  char pad1[LINE - sizeof(long) - 2*sizeof(int)];
+  volatile long head;             // next position to receive
+  volatile int nonempty;          // bumped when a slot is filled and a receiver sleeps
+  volatile int rsleep;            // receivers asleep
+  char pad2[LINE - sizeof(long) - 2*sizeof(int)];
+};
+
+struct slot {
+  volatile long seq;
+  int len;
+  int pad;
+  char data[];
+};
+
+static struct slot*
+slotat(struct shmring *r, long pos)
+{
+  return (struct slot*)((char*)(r + 1) + (pos & (r->nslot - 1)) * r->stride);
+}
+
+// Bytes for nslot slots of msgsize, or -1 if that
+// does not fit in shm_open()'s int size.
+static int
+ringsize(int msgsize, int nslot)
+{
+  uint64 n;
+
+  n = sizeof(struct shmring) + nslot * ((SLOTHDR + (uint64)msgsize + 7) & ~7UL);
+  return n > 0x7fffffff ? -1 : n;
+}
+
+// Create the ring name with room for nmsg messages of up to
+// msgsize bytes, and attach it. nmsg is rounded up to a power
+// of two. Returns 0 if name exists, the ring would be larger
+// than 2GB, or there is no memory.
+struct shmring*
+shmring_create(char *name, int msgsize, int nmsg, int flags)
+{
+  struct shmring *r;
+  int id, n, size;
+
+  if(msgsize <= 0 || nmsg <= 0 || nmsg > (1 << 20))
+    return 0;
+  for(n = 1; n < nmsg; n <<= 1)
+    ;
+  if((size = ringsize(msgsize, n)) < 0)
+    return 0;
+  if((id = shm_open(name, size, SHM_CREAT|SHM_EXCL)) < 0)
+    return 0;
+  if((r = shmat(id)) == (struct shmring*)-1){
+    shm_unlink(name);
+    return 0;
+  }
+  r->flags = flags & SHMRING_MPMC;
+  r->msgsize = msgsize;
+  r->nslot = n;
+  r->stride = (SLOTHDR + msgsize + 7) & ~7;
+  for(long i = 0; i < n; i++)
+    slotat(r, i)->seq = i;
+  __atomic_store_n(&r->magic, MAGIC, __ATOMIC_RELEASE);
+  return r;
+}
+
+// Attach the ring name, made by shmring_create() in this or
+// another process. A forked child can use its parent's
+// pointer instead. Returns 0 if there is no such ring.
+struct shmring*
+shmring_open(char *name)
+{
+  struct shmring *r;
+  int id;
+
+  if((id = shm_open(name, 0, 0)) < 0 || (r = shmat(id)) == (struct shmring*)-1)
+    return 0;
+  if(__atomic_load_n(&r->magic, __ATOMIC_ACQUIRE) != MAGIC){
+    shmdt(r);
+    return 0;
+  }
+  return r;
+}
+
+void
+shmring_close(struct shmring *r)
+{
+  shmdt(r);
+}
+
+// Remove the name; the ring goes away when the last
+// process closes it or exits.
+int
+shmring_unlink(char *name)
+{
+  return shm_unlink(name);
+}
+
+// Claim the slot at *idx whose sequence should be pos + want,
+// where pos is the position claimed. Returns the slot, or 0 if
+// the ring is full (sender) or empty (receiver).
+static struct slot*
+claim(struct shmring *r, volatile long *idx, long want, long *pos)
+{
+  struct slot *s;
+  long p, d;
+
+  p = __atomic_load_n(idx, __ATOMIC_RELAXED);
+  for(;;){
+    s = slotat(r, p);
+    d = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) - (p + want);
+    if(d < 0)
+      return 0;
+    if(d > 0){
+      // another sender or receiver got here first.
+      p = __atomic_load_n(idx, __ATOMIC_RELAXED);
+    } else if((r->flags & SHMRING_MPMC) == 0){
+      __atomic_store_n(idx, p + 1, __ATOMIC_RELAXED);
+      break;
+    } else if(__atomic_compare_exchange_n(idx, &p, p + 1, 0,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED)){
+      break;
+    }
+  }
+  *pos = p;
+  return s;
+}
+
+// Wake the other side if it sleeps. The fence orders the slot's
+// sequence store before the sleeper count load, matching the
+// sleeper's count increment before its recheck.
+static void
+poke(volatile int *event, volatile int *sleepers)
+{
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(sleepers, __ATOMIC_RELAXED)){
+    __sync_fetch_and_add(event, 1);
+    futex_wake(event, 0x7fffffff);
+  }
+}
+
+// Sleep until *event moves, unless a claim now succeeds.
+static struct slot*
+waitfor(struct shmring *r, volatile long *idx, long want, long *pos,
+        volatile int *event, volatile int *sleepers)
+{
+  struct slot *s;
+  int e;
+
+  __sync_fetch_and_add(sleepers, 1);
+  e = __atomic_load_n(event, __ATOMIC_SEQ_CST);
+  if((s = claim(r, idx, want, pos)) == 0)
+    futex_wait(event, e);
+  __sync_fetch_and_sub(sleepers, 1);
+  return s;
+}
+
+// Send the n bytes at buf. Waits while the ring is full unless
+// flags has SHMRING_NOWAIT. Returns n, or -1.
+int
+shmring_send(struct shmring *r, void *buf, int n, int flags)
+{
+  struct slot *s;
+  long pos;
+  int spins = 0;
+
+  if(n < 0 || n > r->msgsize)
+    return -1;
+  while((s = claim(r, &r->tail, 0, &pos)) == 0){
+    if(flags & SHMRING_NOWAIT)
+      return -1;
+    if(++spins >= SPINS && (s = waitfor(r, &r->tail, 0, &pos, &r->nonfull, &r->wsleep)) != 0)
+      break;
+  }
+  memmove(s->data, buf, n);
+  s->len = n;
+  __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+  poke(&r->nonempty, &r->rsleep);
+  return n;
+}
+
+// Receive the oldest message into buf, which holds n bytes;
+// a longer message is cut short. Waits while the ring is
+// empty unless flags has SHMRING_NOWAIT. Returns the bytes
+// copied, or -1.
+int
+shmring_recv(struct shmring *r, void *buf, int n, int flags)
+{
+  struct slot *s;
+  long pos;
+  int spins = 0;
+
+  if(n < 0)
+    return -1;
+  while((s = claim(r, &r->head, 1, &pos)) == 0){
+    if(flags & SHMRING_NOWAIT)
+      return -1;
+    if(++spins >= SPINS && (s = waitfor(r, &r->head, 1, &pos, &r->nonempty, &r->rsleep)) != 0)
+      break;
+  }
+  if(n > s->len)
+    n = s->len;
+  memmove(buf, s->data, n);
+  __atomic_store_n(&s->seq, pos + r->nslot, __ATOMIC_RELEASE);
+  poke(&r->nonfull, &r->wsleep);
+  return n;
+}
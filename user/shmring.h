@@ -0,0 +1,15 @@
+// Message rings in named shared memory, for passing
+// fixed-size-slot messages between processes without
+// entering the kernel unless a side must sleep.
+
+struct shmring;
+
+#define SHMRING_MPMC   0x1    // several senders and receivers; default is one of each
+#define SHMRING_NOWAIT 0x2    // shmring_send/recv: fail instead of waiting
+
+struct shmring* shmring_create(char *name, int msgsize, int nmsg, int flags);
+struct shmring* shmring_open(char *name);
+void shmring_close(struct shmring *r);
+int shmring_unlink(char *name);
+int shmring_send(struct shmring *r, void *buf, int n, int flags);
+int shmring_recv(struct shmring *r, void *buf, int n, int flags);
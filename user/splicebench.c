@@ -0,0 +1,100 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/fcntl.h"
+#include "user/user.h"
+
+// File to pipe to file, the shape of a log shipper. A producer
+// moves a file into a pipe and a child moves the pipe into a
+// second file, ROUNDS times: with read()/write() through a user
+// buffer, with splice() at both ends, and with one sendfile()
+// per pass feeding a splice()ing child.
+
+#define FILESZ (256*1024)   // near MAXFILE
+#define ROUNDS 8
+#define CHUNK  4096
+
+enum { RW, SPLICE, SENDFILE };
+
+char buf[CHUNK];
+
+// Copy in to out, by read()/write(), splice(), or one
+// sendfile(); returns bytes.
+int
+move(int in, int out, int mode)
+{
+  int n, tot = 0;
+
+  if(mode == SENDFILE)
+    return sendfile(out, in, -1, FILESZ);
+  for(;;){
+    if(mode == SPLICE)
+      n = splice(in, out, CHUNK);
+    else if((n = read(in, buf, CHUNK)) > 0 && write(out, buf, n) != n)
+      n = -1;
+    if(n <= 0)
+      break;
+    tot += n;
+  }
+  return n < 0 ? -1 : tot;
+}
+
+// One pass; returns 0 if every byte arrived.
+int
+pass(int mode)
+{
+  int fds[2], in, out, n, xstatus;
+
+  if(pipe(fds) < 0 || (in = open("splicebench.in", O_RDONLY)) < 0)
+    return -1;
+  if(fork() == 0){
+    close(fds[1]);
+    if((out = open("splicebench.out", O_CREATE|O_WRONLY|O_TRUNC)) < 0)
+      exit(1);
+    n = move(fds[0], out, mode == RW ? RW : SPLICE);
+    close(out);
+    exit(n == FILESZ ? 0 : 1);
+  }
+  close(fds[0]);
+  n = move(in, fds[1], mode);
+  close(in);
+  close(fds[1]);
+  wait(&xstatus);
+  return n == FILESZ && xstatus == 0 ? 0 : -1;
+}
+
+void
+run(int mode)
+{
+  static char *names[] = { "read/write", "splice    ", "sendfile  " };
+  int i, t0, bad = 0;
+
+  t0 = uptime();
+  for(i = 0; i < ROUNDS; i++)
+    if(pass(mode) < 0)
+      bad = 1;
+  printf("%s: %d KB in %d ticks%s\n", names[mode],
+         ROUNDS * FILESZ / 1024, uptime() - t0, bad ? " FAILED" : "");
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i;
+
+  if((fd = open("splicebench.in", O_CREATE|O_WRONLY|O_TRUNC)) < 0){
+    printf("splicebench: create failed\n");
+    exit(1);
+  }
+  for(i = 0; i < CHUNK; i++)
+    buf[i] = 'a' + i % 26;
+  for(i = 0; i < FILESZ; i += CHUNK)
+    write(fd, buf, CHUNK);
+  close(fd);
+
+  run(RW);
+  run(SPLICE);
+  run(SENDFILE);
+  unlink("splicebench.in");
+  unlink("splicebench.out");
+  exit(0);
+}
@@ -1,5 +1,9 @@
 // Demonstrate that moving the "acquire" in iderw after the loop that
 // appends to the idequeue results in a race.
+//
+// Also a file system benchmark: five processes each write and
+// read back their own file, contending for the log, the buffer
+// cache and their sleep locks. The first process prints the time.
 
 // For this to work, you should also add a spin within iderw's
 // idequeue traversal loop.  Adding the following demonstrated a panic
@@ -16,11 +20,15 @@
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int fd, i, n, t0;
   char path[] = "stressfs0";
   char data[512];
 
+  n = 20;
+  if(argc > 1)
+    n = atoi(argv[1]);
   printf("stressfs starting\n");
+  t0 = uptime();
   memset(data, 'a', sizeof(data));
 
   for(i = 0; i < 4; i++)
@@ -31,7 +39,7 @@ main(int argc, char *argv[])
 
   path[8] += i;
   fd = open(path, O_CREATE | O_RDWR);
-  for(i = 0; i < 20; i++)
+  for(int j = 0; j < n; j++)
 //    printf(fd, "%d\n", i);
     write(fd, data, sizeof(data));
   close(fd);
@@ -39,11 +47,13 @@ main(int argc, char *argv[])
   printf("read\n");
 
   fd = open(path, O_RDONLY);
-  for (i = 0; i < 20; i++)
+  for (int j = 0; j < n; j++)
     read(fd, data, sizeof(data));
   close(fd);
 
   wait(0);
+  if(i == 0)
+    printf("stressfs: %d blocks per process in %d ticks\n", n, uptime() - t0);
 
   exit(0);
 }
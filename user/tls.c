@@ -0,0 +1,70 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/tls.h"
+
+// Keys are offsets into the TLS block, handed out once
+// per variable and valid in every thread, including
+// threads created before the key.
+
+static volatile int tlsnext;
+
+// Reserve size bytes, 8-byte aligned, in every thread's block.
+// Returns the key, or -1 if the blocks are full.
+int
+tls_alloc(int size)
+{
+  int off;
+
+  if(size <= 0)
+    return -1;
+  size = (size + 7) & ~7;
+  off = __sync_fetch_and_add(&tlsnext, size);
+  if(off + size > TLSSIZE)
+    return -1;
+  return off;
+}
+
+// A zeroed block for a new thread, to pass to clone().
+void*
+tls_newblock(void)
+{
+  void *b;
+
+  if((b = malloc(TLSSIZE)) == 0)
+    return 0;
+  memset(b, 0, TLSSIZE);
+  return b;
+}
+
+void
+tls_freeblock(void *block)
+{
+  if(block)
+    free(block);
+}
+
+// The calling thread's block. exec() starts the first
+// thread with tp zero, so it gets a block on first use.
+void*
+tls_self(void)
+{
+  char *tp;
+
+  asm volatile("addi.d %0, $tp, 0" : "=r" (tp));
+  if(tp == 0){
+    if((tp = tls_newblock()) == 0)
+      return 0;
+    asm volatile("addi.d $tp, %0, 0" : : "r" (tp));
+  }
+  return tp;
+}
+
+void*
+tls_get(int key)
+{
+  char *b;
+
+  if(key < 0 || key >= TLSSIZE || (b = tls_self()) == 0)
+    return 0;
+  return b + key;
+}
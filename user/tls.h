@@ -0,0 +1,14 @@
+// Thread-local storage.
+// Each thread's tp register points at its own TLS block of
+// TLSSIZE bytes. tls_alloc() reserves the same offset in
+// every block, the way a __thread variable would, and
+// tls_get() returns the calling thread's copy, which
+// starts out zero.
+
+#define TLSSIZE 512
+
+int tls_alloc(int size);
+void* tls_get(int key);
+void* tls_self(void);
+void* tls_newblock(void);
+void tls_freeblock(void *block);
@@ -0,0 +1,349 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/uthread.h"
+#include "user/tls.h"
+#include "user/tpool.h"
+
+// Work-stealing thread pool.
+//
+// Each worker, the thread that called tpool_init() being
+// worker 0, owns a Chase-Lev deque of forked tasks. The owner
+// pushes and takes at the bottom without locking; idle workers
+// steal the oldest task from the top of a random victim's
+// deque with one compare-and-swap. A joiner runs other tasks
+// while it waits, and only sleeps on its task once there is
+// nothing left to do. Idle workers sleep on a futex that every
+// push bumps.
+//
+// After Le et al., "Correct and Efficient Work-Stealing for
+// Weak Memory Models", PPoPP 2013.
+
+#define TPMAXWORKER  8
+#define DEQSIZE     64            // tasks per deque, a power of two
+#define SPINS      100            // steal attempts before sleeping
+
+struct deque {
+  volatile long top;              // thieves take here
+  volatile long bottom;           // owner pushes and takes here
+  struct tpool_task *buf[DEQSIZE];
+};
+
+struct tworker {
+  struct deque dq;
+  uint seed;                      // for picking victims
+  int id;
+  int tid;                        // its thread, 0 for worker 0
+};
+
+static struct {
+  struct tworker worker[TPMAXWORKER];
+  int n;                          // workers, 0 if no pool
+  volatile int epoch;             // bumped by every push
+  volatile int sleepers;
+  volatile int stop;
+} pool;
+
+static int tpkey = -1;            // TLS key: this thread's worker
+
+static struct tworker*
+self(void)
+{
+  struct tworker **w;
+
+  if(pool.n == 0 || (w = tls_get(tpkey)) == 0)
+    return 0;
+  return *w;
+}
+
+// Owner only. Returns -1 if the deque is full.
+static int
+push(struct deque *d, struct tpool_task *t)
+{
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+  long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+
+  if(b - top >= DEQSIZE)
+    return -1;
+  d->buf[b & (DEQSIZE-1)] = t;
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+// Owner only: the newest task, or 0.
+static struct tpool_task*
+take(struct deque *d)
+{
+  long b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+  long top;
+  struct tpool_task *t = 0;
+
+  __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  top = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+  if(top <= b){
+    t = d->buf[b & (DEQSIZE-1)];
+    if(top == b){
+      // last one: race thieves for it.
+      if(!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+        t = 0;
+      __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    }
+  } else {
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+  }
+  return t;
+}
+
+// Any thread: the oldest task, or 0 if empty or we lost a race.
+static struct tpool_task*
+steal(struct deque *d)
+{
+  long top = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+  long b;
+  struct tpool_task *t;
+
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+  if(top >= b)
+    return 0;
+  t = d->buf[top & (DEQSIZE-1)];
+  if(!__atomic_compare_exchange_n(&d->top, &top, top + 1, 0,
+                                  __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+    return 0;
+  return t;
+}
+
+// The joiner may return as soon as done is 1, taking t's
+// frame with it, so done is the last thing touched.
+static void
+run(struct tpool_task *t)
+{
+  t->fn(t->arg);
+  if(__atomic_exchange_n(&t->done, 1, __ATOMIC_SEQ_CST) == 2)
+    futex_wake(&t->done, 1);
+}
+
+// Find a task for w: its own newest, else a random victim's oldest.
+static struct tpool_task*
+findwork(struct tworker *w)
+{
+  struct tpool_task *t;
+  int i, v;
+
+  if((t = take(&w->dq)) != 0)
+    return t;
+  for(i = 0; i < pool.n; i++){
+    w->seed = w->seed * 1103515245 + 12345;
+    v = (w->seed >> 16) % pool.n;
+    if(v != w->id && (t = steal(&pool.worker[v].dq)) != 0)
+      return t;
+  }
+  return 0;
+}
+
+static void
+setself(struct tworker *w)
+{
+  *(struct tworker**)tls_get(tpkey) = w;
+}
+
+static void
+workermain(void *arg)
+{
+  struct tworker *w = arg;
+  struct tpool_task *t;
+  int e, spins = 0;
+
+  setself(w);
+  while(!pool.stop){
+    e = pool.epoch;
+    if((t = findwork(w)) != 0){
+      run(t);
+      spins = 0;
+    } else if(++spins >= SPINS){
+      __sync_fetch_and_add(&pool.sleepers, 1);
+      futex_wait(&pool.epoch, e);
+      __sync_fetch_and_sub(&pool.sleepers, 1);
+      spins = 0;
+    }
+  }
+  exit(0);
+}
+
+// Start nworkers-1 threads; the caller is worker 0.
+// Returns the number of workers, or -1.
+int
+tpool_init(int nworkers)
+{
+  int i;
+
+  if(pool.n != 0)
+    return -1;
+  if(nworkers < 1)
+    nworkers = 1;
+  if(nworkers > TPMAXWORKER)
+    nworkers = TPMAXWORKER;
+  if(tpkey < 0 && (tpkey = tls_alloc(sizeof(struct tworker*))) < 0)
+    return -1;
+
+  memset(&pool, 0, sizeof(pool));
+  for(i = 0; i < nworkers; i++){
+    pool.worker[i].id = i;
+    pool.worker[i].seed = i + 1;
+  }
+  pool.n = nworkers;
+  setself(&pool.worker[0]);
+  for(i = 1; i < nworkers; i++){
+    if((pool.worker[i].tid = thread_create(workermain, &pool.worker[i])) < 0){
+      pool.n = i;
+      tpool_shutdown();
+      return -1;
+    }
+  }
+  return nworkers;
+}
+
+// Stop the workers. Every forked task must have been joined.
+// Waits for the pool's own threads only, so other threads of
+// the caller are left for it to join.
+void
+tpool_shutdown(void)
+{
+  int i, n = pool.n;
+
+  if(n == 0)
+    return;
+  pool.stop = 1;
+  __sync_fetch_and_add(&pool.epoch, 1);
+  futex_wake(&pool.epoch, TPMAXWORKER);
+  for(i = 1; i < n; i++)
+    thread_wait(pool.worker[i].tid, 0);
+  setself(0);
+  pool.n = 0;
+}
+
+int
+tpool_nworkers(void)
+{
+  return pool.n ? pool.n : 1;
+}
+
+// Make t available to other workers. Without a pool,
+// or with a full deque, t just runs now.
+void
+tpool_fork(struct tpool_task *t, void (*fn)(void*), void *arg)
+{
+  struct tworker *w = self();
+
+  t->fn = fn;
+  t->arg = arg;
+  t->done = 0;
+  if(w == 0 || push(&w->dq, t) < 0){
+    run(t);
+    return;
+  }
+  __sync_fetch_and_add(&pool.epoch, 1);
+  if(pool.sleepers)
+    futex_wake(&pool.epoch, 1);
+}
+
+// Wait for t, running other tasks meanwhile.
+void
+tpool_join(struct tpool_task *t)
+{
+  struct tworker *w = self();
+  struct tpool_task *x;
+  int spins = 0;
+
+  while(__atomic_load_n(&t->done, __ATOMIC_SEQ_CST) != 1){
+    if(w && (x = findwork(w)) != 0){
+      run(x);
+      spins = 0;
+    } else if(++spins >= SPINS){
+      // t was stolen and there is nothing else to do.
+      int zero = 0;
+      __atomic_compare_exchange_n(&t->done, &zero, 2, 0,
+                                  __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+      futex_wait(&t->done, 2);
+      spins = 0;
+    }
+  }
+}
+
+struct pfor {
+  int lo, hi, grain;
+  void (*body)(int, int, void*);
+  long (*rbody)(int, int, void*);
+  long (*combine)(long, long);
+  void *arg;
+  long result;
+};
+
+// Split the range in halves, forking the right half,
+// until pieces are no bigger than grain.
+static void
+pforstep(void *a)
+{
+  struct pfor *p = a, left, right;
+  struct tpool_task t;
+  int mid;
+
+  if(p->hi - p->lo <= p->grain){
+    if(p->rbody)
+      p->result = p->rbody(p->lo, p->hi, p->arg);
+    else
+      p->body(p->lo, p->hi, p->arg);
+    return;
+  }
+  mid = p->lo + (p->hi - p->lo) / 2;
+  left = right = *p;
+  left.hi = mid;
+  right.lo = mid;
+  tpool_fork(&t, pforstep, &right);
+  pforstep(&left);
+  tpool_join(&t);
+  if(p->rbody)
+    p->result = p->combine(left.result, right.result);
+}
+
+// Call body on pieces of [lo, hi) in parallel.
+void
+tpool_parallel_for(int lo, int hi, int grain,
+                   void (*body)(int lo, int hi, void *arg), void *arg)
+{
+  struct pfor p;
+
+  if(lo >= hi)
+    return;
+  memset(&p, 0, sizeof(p));
+  p.lo = lo;
+  p.hi = hi;
+  p.grain = grain > 0 ? grain : 1;
+  p.body = body;
+  p.arg = arg;
+  pforstep(&p);
+}
+
+// Combine body's results over pieces of [lo, hi) in parallel.
+// combine must be associative. An empty range gives 0.
+long
+tpool_parallel_reduce(int lo, int hi, int grain,
+                      long (*body)(int lo, int hi, void *arg),
+                      long (*combine)(long a, long b), void *arg)
+{
+  struct pfor p;
+
+  if(lo >= hi)
+    return 0;
+  memset(&p, 0, sizeof(p));
+  p.lo = lo;
+  p.hi = hi;
+  p.grain = grain > 0 ? grain : 1;
+  p.rbody = body;
+  p.combine = combine;
+  p.arg = arg;
+  pforstep(&p);
+  return p.result;
+}
@@ -0,0 +1,20 @@
+// Work-stealing thread pool for fork-join parallelism.
+// A task lives in its forker's stack frame; the forker
+// must tpool_join() it before returning.
+
+struct tpool_task {
+  void (*fn)(void*);
+  void *arg;
+  volatile int done;      // 1 when run; 2 while the joiner sleeps
+};
+
+int tpool_init(int nworkers);
+void tpool_shutdown(void);
+int tpool_nworkers(void);
+void tpool_fork(struct tpool_task *t, void (*fn)(void*), void *arg);
+void tpool_join(struct tpool_task *t);
+void tpool_parallel_for(int lo, int hi, int grain,
+                        void (*body)(int lo, int hi, void *arg), void *arg);
+long tpool_parallel_reduce(int lo, int hi, int grain,
+                           long (*body)(int lo, int hi, void *arg),
+                           long (*combine)(long a, long b), void *arg);
@@ -0,0 +1,132 @@
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/tpool.h"
+
+// Parallel sum and parallel merge sort on 1, 2 and 4
+// workers. Scaling shows only when NCPU > 1; on one cpu
+// the numbers measure the pool's overhead.
+
+#define N      32768
+#define GRAIN  1024
+
+int a[N], tmp[N];
+
+long
+sumbody(int lo, int hi, void *arg)
+{
+  long s = 0;
+
+  for(int i = lo; i < hi; i++)
+    s += a[i];
+  return s;
+}
+
+long
+add(long x, long y)
+{
+  return x + y;
+}
+
+void
+merge(int lo, int mid, int hi)
+{
+  int i = lo, j = mid, k = lo;
+
+  while(i < mid && j < hi)
+    tmp[k++] = a[i] <= a[j] ? a[i++] : a[j++];
+  while(i < mid)
+    tmp[k++] = a[i++];
+  while(j < hi)
+    tmp[k++] = a[j++];
+  memmove(a + lo, tmp + lo, (hi - lo) * sizeof(int));
+}
+
+void
+seqsort(int lo, int hi)
+{
+  int mid;
+
+  if(hi - lo < 2)
+    return;
+  mid = lo + (hi - lo) / 2;
+  seqsort(lo, mid);
+  seqsort(mid, hi);
+  merge(lo, mid, hi);
+}
+
+struct range {
+  int lo, hi;
+};
+
+void
+psort(void *arg)
+{
+  struct range *r = arg, left, right;
+  struct tpool_task t;
+  int mid;
+
+  if(r->hi - r->lo <= GRAIN){
+    seqsort(r->lo, r->hi);
+    return;
+  }
+  mid = r->lo + (r->hi - r->lo) / 2;
+  left.lo = r->lo;
+  left.hi = mid;
+  right.lo = mid;
+  right.hi = r->hi;
+  tpool_fork(&t, psort, &right);
+  psort(&left);
+  tpool_join(&t);
+  merge(r->lo, mid, r->hi);
+}
+
+void
+fill(void)
+{
+  uint x = 1;
+
+  for(int i = 0; i < N; i++){
+    x = x * 1103515245 + 12345;
+    a[i] = (x >> 8) % 100000;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n, i, t0;
+  long sum, want;
+  struct range all = { 0, N };
+
+  fill();
+  want = sumbody(0, N, 0);
+  for(n = 1; n <= 4; n *= 2){
+    if(tpool_init(n) < 0){
+      printf("tpoolbench: tpool_init(%d) failed\n", n);
+      exit(1);
+    }
+
+    t0 = uptime();
+    for(i = 0; i < 20; i++)
+      sum = tpool_parallel_reduce(0, N, GRAIN, sumbody, add, 0);
+    printf("%d workers: sum x20 in %d ticks\n", n, uptime() - t0);
+    if(sum != want){
+      printf("tpoolbench: sum %l, want %l\n", sum, want);
+      exit(1);
+    }
+
+    fill();
+    t0 = uptime();
+    psort(&all);
+    printf("%d workers: sort %d ints in %d ticks\n", n, N, uptime() - t0);
+    for(i = 1; i < N; i++){
+      if(a[i-1] > a[i]){
+        printf("tpoolbench: not sorted at %d\n", i);
+        exit(1);
+      }
+    }
+    tpool_shutdown();
+  }
+  exit(0);
+}
@@ -0,0 +1,93 @@
+#include "kernel/types.h"
+#include "user/user.h"
+#include "user/umutex.h"
+
+// Mutex after Drepper, "Futexes Are Tricky": the uncontended
+// lock and unlock are one atomic instruction each, and the
+// kernel is entered only to block, or to wake a blocked thread.
+
+static int
+cas(volatile int *p, int old, int new)
+{
+  return __sync_val_compare_and_swap(p, old, new);
+}
+
+static int
+xchg(volatile int *p, int v)
+{
+  return __atomic_exchange_n(p, v, __ATOMIC_ACQUIRE);
+}
+
+void
+umutex_init(struct umutex *m)
+{
+  m->state = 0;
+}
+
+void
+umutex_lock(struct umutex *m)
+{
+  int c;
+
+  if((c = cas(&m->state, 0, 1)) == 0)
+    return;
+  // contended: advertise a waiter, then sleep until we
+  // are the one that swaps the lock from 0.
+  if(c != 2)
+    c = xchg(&m->state, 2);
+  while(c != 0){
+    futex_wait(&m->state, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+int
+umutex_trylock(struct umutex *m)
+{
+  return cas(&m->state, 0, 1) == 0;
+}
+
+void
+umutex_unlock(struct umutex *m)
+{
+  if(__sync_fetch_and_sub(&m->state, 1) != 1){
+    // there may be waiters.
+    __atomic_store_n(&m->state, 0, __ATOMIC_RELEASE);
+    futex_wake(&m->state, 1);
+  }
+}
+
+void
+ucond_init(struct ucond *c)
+{
+  c->seq = 0;
+}
+
+// Wait for a signal. m must be held; it is held again on return.
+// As with any condition variable, recheck the predicate.
+void
+ucond_wait(struct ucond *c, struct umutex *m)
+{
+  int seq = c->seq;
+
+  umutex_unlock(m);
+  futex_wait(&c->seq, seq);
+  // other threads may be queued on m by now, so take
+  // it in the contended state to make unlock wake them.
+  while(xchg(&m->state, 2) != 0)
+    futex_wait(&m->state, 2);
+}
+
+void
+ucond_signal(struct ucond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 1);
+}
+
+void
+ucond_broadcast(struct ucond *c)
+{
+  __sync_fetch_and_add(&c->seq, 1);
+  futex_wake(&c->seq, 0x7fffffff);
+}
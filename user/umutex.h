@@ -0,0 +1,19 @@
+// Futex-based locks for threads and processes sharing memory.
+// A zeroed struct is an unlocked mutex / condition variable.
+
+struct umutex {
+  volatile int state;   // 0 unlocked, 1 locked, 2 locked with waiters
+};
+
+struct ucond {
+  volatile int seq;     // bumped by every signal
+};
+
+void umutex_init(struct umutex *m);
+void umutex_lock(struct umutex *m);
+int umutex_trylock(struct umutex *m);
+void umutex_unlock(struct umutex *m);
+void ucond_init(struct ucond *c);
+void ucond_wait(struct ucond *c, struct umutex *m);
+void ucond_signal(struct ucond *c);
+void ucond_broadcast(struct ucond *c);
@@ -1,4 +1,7 @@
 struct stat;
+struct sembuf;
+struct mqattr;
+struct msgvec;
 struct rtcdate;
 
 // system calls
@@ -30,16 +33,40 @@ int sem_create (int n_sem);
 int sem_p(int sem_id);
 int sem_v(int sem_id);	
 int sem_free (int sem_id);
+int sem_trywait(int sem_id);
+int sem_timedwait(int sem_id, int nticks);
+int semop(struct sembuf *ops, int nops);
 void* shmgetat(uint key, uint num);
 int shmrefcount(uint key);
 int mqget(uint);
-int msgsnd(uint, int, int, char*);
-int msgrcv(uint, int, int, uint64);
-int clone(void (*fcn)(void *), void *stack, void *arg); 
-int join();
+int mqopen(uint key, struct mqattr *attr);
+int mqstat(int mqid, struct mqattr *attr);
+int msgsnd(uint, int, int, char*, int, int);
+int msgrcv(uint, int, int, uint64, int, int);
+int msgsnd_batch(uint mqid, struct msgvec *v, int n, int flags, int timeout);
+int msgrcv_batch(uint mqid, int type, struct msgvec *v, int n, int flags, int timeout);
+int msgsnd_pages(uint mqid, int type, void *buf, int len, int flags, int timeout);
+char* msgrcv_pages(uint mqid, int type, int *len, int flags, int timeout);
+int shm_open(char *name, int size, int flags);
+void* shmat(int id);
+int shmdt(void *addr);
+int shm_unlink(char *name);
+int fcntl(int fd, int cmd, int arg);
+int nswitch(void);
+int splice(int fdin, int fdout, int n);
+int tee(int fdin, int fdout, int n);
+int sendfile(int outfd, int infd, int off, int n);
+int clone(void (*fcn)(void *), void *stack, void *arg, void *tls);
+int join(int tid, int *status);
+int detach(int tid, volatile int *exited);
+int lockstat(int reset);
 uint64 myalloc(int);
 int myfree(uint64);
 int getcpuid(void);
+int sched_setaffinity(int pid, uint mask);
+int sched_getaffinity(int pid);
+int futex_wait(volatile int *addr, int val);
+int futex_wake(volatile int *addr, int n);
 // ulib.c
 int stat(const char*, struct stat*);
 char* strcpy(char*, const char*);
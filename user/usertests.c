@@ -2,8 +2,13 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "user/user.h"
+#include "user/uthread.h"
+#include "user/tls.h"
+#include "user/shmring.h"
 #include "kernel/fs.h"
 #include "kernel/fcntl.h"
+#include "kernel/sem.h"
+#include "kernel/shm.h"
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/loongarch.h"
@@ -780,6 +785,321 @@ pipe1(char *s)
 }
 
 
+// The pipe, splice and sendfile tests move n bytes of the
+// pattern i % k and check them on the other side.
+void
+fillpat(char *b, int n, int k)
+{
+  for(int i = 0; i < n; i++)
+    b[i] = i % k;
+}
+
+// Return the index of the first of the n bytes at b that
+// breaks the pattern, or -1.
+int
+badpat(char *b, int n, int k)
+{
+  for(int i = 0; i < n; i++)
+    if(b[i] != (char)(i % k))
+      return i;
+  return -1;
+}
+
+// Create file name holding the n bytes at b.
+void
+writefile(char *s, char *name, char *b, int n)
+{
+  int fd;
+
+  fd = open(name, O_CREATE|O_RDWR|O_TRUNC);
+  if(fd < 0 || write(fd, b, n) != n){
+    printf("%s: create %s failed\n", s, name);
+    exit(1);
+  }
+  close(fd);
+}
+
+
+// pipe bandwidth, after lmbench bw_pipe: a child writes
+// 64KB chunks, the parent reads them and checks the bytes.
+void
+pipebw(char *s)
+{
+  enum { CHUNK = 64*1024, TOTAL = 4*1024*1024 };
+  int fds[2], pid, xstatus, n, got, t0, i;
+  char *b;
+
+  if(pipe(fds) != 0 || (b = malloc(CHUNK)) == 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  fillpat(b, CHUNK, 251);
+  t0 = uptime();
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork() failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < TOTAL; n += CHUNK)
+      if(write(fds[1], b, CHUNK) != CHUNK){
+        printf("%s: short write\n", s);
+        exit(1);
+      }
+    exit(0);
+  }
+  close(fds[1]);
+  got = 0;
+  while((n = read(fds[0], b, CHUNK)) > 0){
+    for(i = 0; i < n; i += 4093)
+      if(b[i] != (char)((got + i) % CHUNK % 251)){
+        printf("%s: wrong byte at %d\n", s, got + i);
+        exit(1);
+      }
+    got += n;
+  }
+  close(fds[0]);
+  wait(&xstatus);
+  if(got != TOTAL || xstatus != 0){
+    printf("%s: read %d bytes of %d\n", s, got, TOTAL);
+    exit(1);
+  }
+  printf("%d KB in %d ticks ", TOTAL / 1024, uptime() - t0);
+  free(b);
+}
+
+
+// pipe capacity: the default holds 16KB without blocking,
+// F_SETPIPE_SZ rounds up and keeps what is buffered, and
+// refuses to shrink below it.
+void
+pipesize(char *s)
+{
+  enum { N = 16*1024 };
+  int fds[2], i, n;
+  char *b;
+
+  if(pipe(fds) != 0 || (b = malloc(2*N)) == 0){
+    printf("%s: pipe() failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_GETPIPE_SZ, 0) < N){
+    printf("%s: default size %d\n", s, fcntl(fds[0], F_GETPIPE_SZ, 0));
+    exit(1);
+  }
+  fillpat(b, 2*N, 253);
+  if(write(fds[1], b, N - 100) != N - 100){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 4096) != -1){
+    printf("%s: shrank below the buffered data\n", s);
+    exit(1);
+  }
+  if(fcntl(fds[1], F_SETPIPE_SZ, 2*N - 1) != 2*N || fcntl(fds[0], F_GETPIPE_SZ, 0) != 2*N){
+    printf("%s: F_SETPIPE_SZ did not round up to %d\n", s, 2*N);
+    exit(1);
+  }
+  if(write(fds[1], b + N - 100, N + 100) != N + 100){
+    printf("%s: write after grow failed\n", s);
+    exit(1);
+  }
+  memset(b, 0, 2*N);
+  for(i = 0; i < 2*N; i += n)
+    if((n = read(fds[0], b + i, 2*N - i)) <= 0){
+      printf("%s: read failed\n", s);
+      exit(1);
+    }
+  if((i = badpat(b, 2*N, 253)) >= 0){
+    printf("%s: wrong byte at %d\n", s, i);
+    exit(1);
+  }
+  if(fcntl(fds[0], F_SETPIPE_SZ, 1) != 4096 || fcntl(0, F_GETPIPE_SZ, 0) != -1){
+    printf("%s: shrink or non-pipe fcntl wrong\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fds[1]);
+  free(b);
+}
+
+
+// splice() a file into a pipe, tee() it into a second pipe,
+// and splice() both pipes out to files, which must match the
+// original.
+void
+splicetee(char *s)
+{
+  enum { N = 20000 };
+  int fd, out1, out2, p1[2], p2[2], i, n, got;
+  char *b;
+
+  if((b = malloc(N)) == 0 || pipe(p1) != 0 || pipe(p2) != 0){
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  fcntl(p1[0], F_SETPIPE_SZ, 32*1024);
+  fcntl(p2[0], F_SETPIPE_SZ, 32*1024);
+  fillpat(b, N, 249);
+  writefile(s, "splicein", b, N);
+
+  fd = open("splicein", O_RDONLY);
+  for(got = 0; got < N; got += n)
+    if((n = splice(fd, p1[1], N - got)) <= 0){
+      printf("%s: splice file to pipe gave %d\n", s, n);
+      exit(1);
+    }
+  if(splice(fd, p1[1], 10) != 0){
+    printf("%s: splice past end of file\n", s);
+    exit(1);
+  }
+  // zero bytes with data waiting must return, not spin.
+  if(splice(p1[0], p2[1], 0) != 0 || tee(p1[0], p2[1], 0) != 0){
+    printf("%s: zero-byte splice or tee failed\n", s);
+    exit(1);
+  }
+  // out of a write end, or into a read end, while both are open.
+  if(splice(p1[1], p2[1], 10) != -1 || splice(fd, p1[0], 10) != -1 ||
+     tee(p1[1], p2[1], 10) != -1 || tee(p1[0], p2[0], 10) != -1){
+    printf("%s: splice onto the wrong end accepted\n", s);
+    exit(1);
+  }
+  close(fd);
+  close(p1[1]);
+
+  if((n = tee(p1[0], p2[1], N)) != N){
+    printf("%s: tee gave %d\n", s, n);
+    exit(1);
+  }
+  close(p2[1]);
+
+  out1 = open("spliceout1", O_CREATE|O_RDWR|O_TRUNC);
+  out2 = open("spliceout2", O_CREATE|O_RDWR|O_TRUNC);
+  while((n = splice(p1[0], out1, 3000)) > 0)
+    ;
+  while((n = splice(p2[0], out2, N)) > 0)
+    ;
+  close(p1[0]);
+  close(p2[0]);
+  close(out1);
+  close(out2);
+
+  for(i = 1; i <= 2; i++){
+    fd = open(i == 1 ? "spliceout1" : "spliceout2", O_RDONLY);
+    memset(b, 0, N);
+    for(got = 0; got < N && (n = read(fd, b + got, N - got)) > 0; got += n)
+      ;
+    if(got != N || read(fd, b, 1) != 0){
+      printf("%s: spliceout%d has %d bytes\n", s, i, got);
+      exit(1);
+    }
+    if((n = badpat(b, N, 249)) >= 0){
+      printf("%s: spliceout%d wrong at %d\n", s, i, n);
+      exit(1);
+    }
+    close(fd);
+  }
+  unlink("splicein");
+  unlink("spliceout1");
+  unlink("spliceout2");
+  free(b);
+}
+
+
+// sendfile() into a pipe bigger than the pipe, from the file
+// offset and from an explicit one, and refusals for ends that
+// are not a file and a pipe or device.
+void
+sendfiletest(char *s)
+{
+  enum { N = 40000 };
+  int fd, fds[2], pid, xstatus, i, n, got;
+  char *b;
+
+  if((b = malloc(N)) == 0 || pipe(fds) != 0){
+    printf("%s: setup failed\n", s);
+    exit(1);
+  }
+  fillpat(b, N, 247);
+  writefile(s, "sendfilein", b, N);
+  fd = open("sendfilein", O_RDONLY);
+  if(sendfile(fd, fds[1], -1, 10) != -1 || sendfile(fds[1], fds[0], -1, 10) != -1){
+    printf("%s: bad ends accepted\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    close(fds[0]);
+    // all of it from the file offset, past the end, then the
+    // first 100 bytes again from offset 0.
+    if(sendfile(fds[1], fd, -1, N + 50) != N || sendfile(fds[1], fd, -1, 10) != 0 ||
+       sendfile(fds[1], fd, 0, 100) != 100)
+      exit(1);
+    exit(0);
+  }
+  close(fds[1]);
+  memset(b, 0, N);
+  for(got = 0; got < N && (n = read(fds[0], b + got, N - got)) > 0; got += n)
+    ;
+  if((i = badpat(b, N, 247)) >= 0){
+    printf("%s: wrong byte at %d\n", s, i);
+    exit(1);
+  }
+  for(got = 0; got < 100 && (n = read(fds[0], b + got, 100 - got)) > 0; got += n)
+    ;
+  if(got != 100 || b[99] != 99 || read(fds[0], b, 1) != 0){
+    printf("%s: second send wrong\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: sendfile returned wrong counts\n", s);
+    exit(1);
+  }
+  close(fds[0]);
+  close(fd);
+  unlink("sendfilein");
+  free(b);
+}
+
+
+// sendfile() to the console device, which readiblocks() feeds
+// block by block through devsw[].write.
+void
+sendfiledev(char *s)
+{
+  static char msg[] = "(sendfile to console) ";
+  int fd, cfd, n = sizeof(msg) - 1;
+
+  writefile(s, "sendfiledev", msg, n);
+  fd = open("sendfiledev", O_RDONLY);
+  if((cfd = open("console", O_RDONLY)) >= 0){
+    if(sendfile(cfd, fd, 0, n) != -1){
+      printf("%s: sendfile to read-only console accepted\n", s);
+      exit(1);
+    }
+    close(cfd);
+  }
+  if((cfd = open("console", O_WRONLY)) < 0){
+    printf("%s: open console failed\n", s);
+    exit(1);
+  }
+  if(sendfile(cfd, fd, 0, n + 10) != n || sendfile(cfd, fd, n, 10) != 0){
+    printf("%s: sendfile to console returned wrong count\n", s);
+    exit(1);
+  }
+  close(cfd);
+  close(fd);
+  unlink("sendfiledev");
+}
+
+
 // test if child is killed (status = -1)
 void
 killstatus(char *s)
@@ -2080,6 +2400,511 @@ forktest(char *s)
   }
 }
 
+// fork many children that exit at once, then reap them all,
+// and report the clock ticks it took. with per-parent zombie
+// lists each wait() costs the same however many children exist.
+void
+forkwaitmany(char *s)
+{
+  enum{ N = 200, ROUNDS = 5 };
+  int i, round, pid, t0;
+
+  t0 = uptime();
+  for(round = 0; round < ROUNDS; round++){
+    for(i = 0; i < N; i++){
+      pid = fork();
+      if(pid < 0){
+        printf("%s: fork %d failed\n", s, i);
+        exit(1);
+      }
+      if(pid == 0)
+        exit(0);
+    }
+    for(i = 0; i < N; i++){
+      if(wait(0) < 0){
+        printf("%s: wait stopped early\n", s);
+        exit(1);
+      }
+    }
+    if(wait(0) != -1){
+      printf("%s: wait got too many\n", s);
+      exit(1);
+    }
+  }
+  printf("%d fork/wait pairs in %d ticks ", N * ROUNDS, uptime() - t0);
+}
+
+volatile int tgrown;
+char *tgpage[8];
+
+void
+tgsbrk(void *arg)
+{
+  char *a = sbrk(4096);
+
+  if(a == (char*)-1)
+    exit(1);
+  a[0] = 1;
+  tgpage[__sync_fetch_and_add(&tgrown, 1)] = a;
+  exit(0);
+}
+
+void
+tgspin(void *arg)
+{
+  __sync_fetch_and_add(&tgrown, 1);
+  for(;;)
+    ;
+}
+
+int tlskey;
+volatile int tlsok;
+
+void
+tlsworker(void *arg)
+{
+  int *v = tls_get(tlskey);
+
+  if(v == 0 || *v != 0)
+    exit(1);
+  *v = (int)(uint64)arg;
+  for(int i = 0; i < 100; i++){
+    sleep(0);
+    if(*(int*)tls_get(tlskey) != (int)(uint64)arg)
+      exit(1);
+  }
+  __sync_fetch_and_add(&tlsok, 1);
+  exit(0);
+}
+
+// each thread sees its own copy of a TLS variable.
+void
+tlstest(char *s)
+{
+  enum { N = 4 };
+  int i, *v;
+
+  if((tlskey = tls_alloc(sizeof(int))) < 0){
+    printf("%s: tls_alloc failed\n", s);
+    exit(1);
+  }
+  v = tls_get(tlskey);
+  *v = -1;
+  for(i = 0; i < N; i++){
+    if(thread_create(tlsworker, (void*)(uint64)(i + 1)) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  for(i = 0; i < N; i++)
+    thread_join();
+  if(tlsok != N || *(int*)tls_get(tlskey) != -1){
+    printf("%s: tls variable shared between threads\n", s);
+    exit(1);
+  }
+}
+
+volatile int jtgo;
+
+void
+jtworker(void *arg)
+{
+  while(!jtgo)
+    sleep(1);
+  exit((int)(uint64)arg);
+}
+
+// join() a chosen thread and get its exit status; a detached
+// thread cannot be joined and is gone once it exits.
+void
+jointid(char *s)
+{
+  enum { N = 3 };
+  int i, tid[N], d, status;
+
+  for(i = 0; i < N; i++){
+    if((tid[i] = thread_create(jtworker, (void*)(uint64)(10 + i))) < 0){
+      printf("%s: thread_create failed\n", s);
+      exit(1);
+    }
+  }
+  if((d = thread_create(jtworker, (void*)99)) < 0 || thread_detach(d) < 0){
+    printf("%s: detach failed\n", s);
+    exit(1);
+  }
+  if(join(d, 0) != -1){
+    printf("%s: joined a detached thread\n", s);
+    exit(1);
+  }
+  jtgo = 1;
+  for(i = N - 1; i >= 0; i--){
+    if(thread_wait(tid[i], &status) != tid[i] || status != 10 + i){
+      printf("%s: join %d got status %d\n", s, tid[i], status);
+      exit(1);
+    }
+  }
+  if(join(tid[0], 0) != -1){
+    printf("%s: joined a thread twice\n", s);
+    exit(1);
+  }
+  if(thread_join() != 0){
+    printf("%s: detached thread was left to join\n", s);
+    exit(1);
+  }
+}
+
+int jatid;
+
+// joins whatever sibling exits, then finds nothing left: the
+// leader, itself and a running detached thread are not joinable.
+void
+jaworker(void *arg)
+{
+  int status;
+
+  if(join(0, &status) != jatid || status != 7)
+    exit(1);
+  exit(join(0, 0) == -1 ? 0 : 2);
+}
+
+// join(0) from a thread other than the leader.
+void
+joinany(char *s)
+{
+  int d, w, status;
+
+  if((d = thread_create(jtworker, (void*)99)) < 0 || thread_detach(d) < 0 ||
+     (jatid = thread_create(jtworker, (void*)7)) < 0 ||
+     (w = thread_create(jaworker, 0)) < 0){
+    printf("%s: thread_create failed\n", s);
+    exit(1);
+  }
+  jtgo = 1;
+  if(thread_wait(w, &status) != w || status != 0){
+    printf("%s: worker's join(0) gave status %d\n", s, status);
+    exit(1);
+  }
+}
+
+void
+semfreeworker(void *arg)
+{
+  exit(sem_p((int)(uint64)arg) == -1 ? 0 : 1);
+}
+
+// sem_trywait, sem_timedwait, all-or-nothing semop, and
+// freeing a semaphore out from under a waiter.
+void
+semops(char *s)
+{
+  struct sembuf ops[2];
+  int a, b, t0, tid, status;
+
+  if((a = sem_create(0)) < 0){
+    printf("%s: sem_create failed\n", s);
+    exit(1);
+  }
+  if(sem_trywait(a) != -1){
+    printf("%s: sem_trywait took a unit from 0\n", s);
+    exit(1);
+  }
+  t0 = uptime();
+  if(sem_timedwait(a, 3) != -1 || uptime() - t0 < 2){
+    printf("%s: sem_timedwait did not time out\n", s);
+    exit(1);
+  }
+  sem_v(a);
+  if(sem_trywait(a) != 0){
+    printf("%s: sem_trywait failed\n", s);
+    exit(1);
+  }
+
+  // a has 1, b has 0: taking both must wait, and
+  // failing must leave a alone.
+  b = sem_create(0);
+  sem_v(a);
+  ops[0].sem_id = a;
+  ops[0].sem_op = -1;
+  ops[0].sem_flg = 0;
+  ops[1].sem_id = b;
+  ops[1].sem_op = -1;
+  ops[1].sem_flg = SEM_NOWAIT;
+  if(semop(ops, 2) != -1){
+    printf("%s: semop took a missing unit\n", s);
+    exit(1);
+  }
+  sem_v(b);
+  if(semop(ops, 2) != 0 || sem_trywait(a) != -1 || sem_trywait(b) != -1){
+    printf("%s: semop did not take both units\n", s);
+    exit(1);
+  }
+
+  if((tid = thread_create(semfreeworker, (void*)(uint64)b)) < 0){
+    printf("%s: thread_create failed\n", s);
+    exit(1);
+  }
+  sleep(2);
+  sem_free(b);
+  if(thread_wait(tid, &status) != tid || status != 0){
+    printf("%s: waiter did not fail when its semaphore was freed\n", s);
+    exit(1);
+  }
+  if(sem_v(b) != -1){
+    printf("%s: freed semaphore id still works\n", s);
+    exit(1);
+  }
+  sem_free(a);
+}
+
+// named shared memory spanning several 2MB page tables:
+// shm_open() semantics, sharing with a forked child, shmdt(),
+// and an unlinked object living on until the last detach.
+void
+shmobj(char *s)
+{
+  enum { SZ = 5*1024*1024 };
+  int id, id2, pid, xstatus, i;
+  char *a, *b;
+
+  shm_unlink("ut_shm");
+  if(shm_open("ut_shm", SZ, 0) != -1){
+    printf("%s: shm_open found a missing object\n", s);
+    exit(1);
+  }
+  if((id = shm_open("ut_shm", SZ, SHM_CREAT|SHM_EXCL)) < 0){
+    printf("%s: shm_open create failed\n", s);
+    exit(1);
+  }
+  if(shm_open("ut_shm", SZ, SHM_CREAT|SHM_EXCL) != -1 ||
+     shm_open("ut_shm", SZ+1, 0) != -1){
+    printf("%s: shm_open reopened with EXCL or a larger size\n", s);
+    exit(1);
+  }
+  if((id2 = shm_open("ut_shm", 4096, 0)) != id){
+    printf("%s: shm_open gave %d, not %d\n", s, id2, id);
+    exit(1);
+  }
+  a = shmat(id);
+  b = shmat(id);
+  if(a == (char*)-1 || b == (char*)-1 || a == b || ((uint64)a & (2*1024*1024-1))){
+    printf("%s: shmat gave %p and %p\n", s, a, b);
+    exit(1);
+  }
+  for(i = 0; i < SZ; i += 4096)
+    if(a[i] != 0){
+      printf("%s: new object not zeroed\n", s);
+      exit(1);
+    }
+  a[0] = 'x';
+  a[SZ-1] = 'y';
+  if(b[0] != 'x' || b[SZ-1] != 'y'){
+    printf("%s: two attachments differ\n", s);
+    exit(1);
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    if(a[0] != 'x')
+      exit(1);
+    for(i = 0; i < SZ; i += 4096)
+      a[i] = 'c';
+    shmdt(b);
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0 || a[4096] != 'c' || b[SZ-4096] != 'c'){
+    printf("%s: child's writes not seen\n", s);
+    exit(1);
+  }
+
+  if(shmdt(b) != 0 || shmdt(b) != -1){
+    printf("%s: shmdt wrong\n", s);
+    exit(1);
+  }
+  if(shm_unlink("ut_shm") != 0 || shm_open("ut_shm", 0, 0) != -1){
+    printf("%s: shm_unlink did not remove the name\n", s);
+    exit(1);
+  }
+  if(a[0] != 'c'){
+    printf("%s: unlinked object lost while attached\n", s);
+    exit(1);
+  }
+  shmdt(a);
+  if(shmat(id) != (char*)-1){
+    printf("%s: freed object attached again\n", s);
+    exit(1);
+  }
+}
+
+// shared memory rings: order and NOWAIT on a one-to-one ring,
+// then every message arriving exactly once through a ring with
+// three senders and three receivers.
+void
+shmringtest(char *s)
+{
+  enum { NSLOT = 8, N = 3000, NSIDE = 3 };
+  struct shmring *r;
+  int i, v, pid, xstatus, fds[2];
+  long sum, total;
+
+  shmring_unlink("ut_ring");
+  if((r = shmring_create("ut_ring", sizeof(int), NSLOT, 0)) == 0){
+    printf("%s: shmring_create failed\n", s);
+    exit(1);
+  }
+  if(shmring_create("ut_ring", sizeof(int), NSLOT, 0) != 0 ||
+     shmring_recv(r, &v, sizeof(v), SHMRING_NOWAIT) != -1){
+    printf("%s: duplicate name or empty receive accepted\n", s);
+    exit(1);
+  }
+  // sizes past 2GB must fail, not wrap to a small ring.
+  if(shmring_create("ut_ring2", 0x7ffffff0, 4, 0) != 0 ||
+     shmring_create("ut_ring2", 1 << 20, 1 << 20, 0) != 0){
+    printf("%s: oversized ring accepted\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NSLOT; i++)
+    shmring_send(r, &i, sizeof(i), SHMRING_NOWAIT);
+  if(shmring_send(r, &i, sizeof(i), SHMRING_NOWAIT) != -1){
+    printf("%s: send to a full ring accepted\n", s);
+    exit(1);
+  }
+  for(i = 0; i < NSLOT; i++)
+    if(shmring_recv(r, &v, sizeof(v), 0) != sizeof(v) || v != i){
+      printf("%s: got %d, want %d\n", s, v, i);
+      exit(1);
+    }
+  pid = fork();
+  if(pid == 0){
+    for(i = 0; i < N; i++)
+      shmring_send(r, &i, sizeof(i), 0);
+    exit(0);
+  }
+  for(i = 0; i < N; i++)
+    if(shmring_recv(r, &v, sizeof(v), 0) != sizeof(v) || v != i){
+      printf("%s: got %d, want %d\n", s, v, i);
+      exit(1);
+    }
+  wait(&xstatus);
+  shmring_close(r);
+  shmring_unlink("ut_ring");
+
+  if((r = shmring_create("ut_ring", sizeof(long), NSLOT, SHMRING_MPMC)) == 0 ||
+     pipe(fds) < 0){
+    printf("%s: shmring_create mpmc failed\n", s);
+    exit(1);
+  }
+  for(i = 0; i < 2*NSIDE; i++){
+    if(fork() == 0){
+      struct shmring *rr = shmring_open("ut_ring");
+      long x;
+      if(rr == 0)
+        exit(1);
+      sum = 0;
+      for(v = 1; v <= N; v++){
+        if(i < NSIDE){
+          x = v;
+          shmring_send(rr, &x, sizeof(x), 0);
+        } else {
+          shmring_recv(rr, &x, sizeof(x), 0);
+          sum += x;
+        }
+      }
+      if(i >= NSIDE)
+        write(fds[1], &sum, sizeof(sum));
+      exit(0);
+    }
+  }
+  close(fds[1]);
+  total = 0;
+  for(i = 0; i < NSIDE; i++){
+    if(read(fds[0], &sum, sizeof(sum)) != sizeof(sum)){
+      printf("%s: receiver failed\n", s);
+      exit(1);
+    }
+    total += sum;
+  }
+  close(fds[0]);
+  for(i = 0; i < 2*NSIDE; i++){
+    wait(&xstatus);
+    if(xstatus != 0){
+      printf("%s: a process failed\n", s);
+      exit(1);
+    }
+  }
+  shmring_close(r);
+  shmring_unlink("ut_ring");
+  if(total != (long)NSIDE*N*(N+1)/2){
+    printf("%s: received sum %d, want %d\n", s, (int)total, NSIDE*N*(N+1)/2);
+    exit(1);
+  }
+}
+
+// several threads share one size and one page table,
+// and exit() of the main thread takes the rest along.
+void
+threadgroup(char *s)
+{
+  enum { N = 6 };
+  int i, j, pid, xstatus;
+
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    for(i = 0; i < N; i++){
+      if(thread_create(tgsbrk, 0) < 0){
+        printf("%s: thread_create %d failed\n", s, i);
+        exit(1);
+      }
+    }
+    for(i = 0; i < N; i++){
+      if(thread_join() <= 0){
+        printf("%s: thread_join %d failed\n", s, i);
+        exit(1);
+      }
+    }
+    if(tgrown != N){
+      printf("%s: %d threads ran\n", s, tgrown);
+      exit(1);
+    }
+    for(i = 0; i < N; i++){
+      for(j = 0; j < i; j++){
+        if(tgpage[i] == tgpage[j]){
+          printf("%s: threads did not grow a shared heap\n", s);
+          exit(1);
+        }
+      }
+      if(tgpage[i][0] != 1){
+        printf("%s: thread's page not visible\n", s);
+        exit(1);
+      }
+    }
+
+    // leave threads running; exit() must stop them
+    // before the address space goes away.
+    tgrown = 0;
+    for(i = 0; i < N; i++){
+      if(thread_create(tgspin, 0) < 0){
+        printf("%s: thread_create failed\n", s);
+        exit(1);
+      }
+    }
+    while(tgrown != N)
+      ;
+    exit(0);
+  }
+  wait(&xstatus);
+  if(xstatus != 0)
+    exit(1);
+}
+
 void
 sbrkbasic(char *s)
 {
@@ -2870,6 +3695,11 @@ main(int argc, char *argv[])
     {iputtest, "iput"},
     {mem, "mem"},
     {pipe1, "pipe1"},
+    {pipebw, "pipebw"},
+    {pipesize, "pipesize"},
+    {splicetee, "splicetee"},
+    {sendfiletest, "sendfile"},
+    {sendfiledev, "sendfiledev"},
     {killstatus, "killstatus"},
     {preempt, "preempt"},
     {exitwait, "exitwait"},
@@ -2879,6 +3709,14 @@ main(int argc, char *argv[])
     {dirfile, "dirfile"},
     {iref, "iref"},
     {forktest, "forktest"},
+    {forkwaitmany, "forkwaitmany"},
+    {threadgroup, "threadgroup"},
+    {tlstest, "tls"},
+    {jointid, "jointid"},
+    {joinany, "joinany"},
+    {semops, "semops"},
+    {shmobj, "shmobj"},
+    {shmringtest, "shmring"},
     {bigdir, "bigdir"}, // slow
     { 0, 0},
   };
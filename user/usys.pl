@@ -44,12 +44,36 @@ entry("sem_create");
 entry("sem_p");
 entry("sem_v");
 entry("sem_free");
+entry("sem_trywait");
+entry("sem_timedwait");
+entry("semop");
 entry("shmgetat");
 entry("shmrefcount");
 entry("mqget");
+entry("mqopen");
+entry("mqstat");
 entry("msgsnd");
 entry("msgrcv");
+entry("msgsnd_batch");
+entry("msgrcv_batch");
+entry("msgsnd_pages");
+entry("msgrcv_pages");
+entry("shm_open");
+entry("shmat");
+entry("shmdt");
+entry("shm_unlink");
+entry("fcntl");
+entry("nswitch");
+entry("splice");
+entry("tee");
+entry("sendfile");
 entry("clone");
 entry("join");
 entry("myalloc");
 entry("myfree");
+entry("sched_setaffinity");
+entry("sched_getaffinity");
+entry("futex_wait");
+entry("futex_wake");
+entry("detach");
+entry("lockstat");
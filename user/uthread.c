@@ -1,21 +1,29 @@
 #include "kernel/types.h"
+#include "kernel/param.h"
 #include "user/user.h"
 #include "uthread.h"
+#include "tls.h"
 
-#define NTHREAD 4     // 一个进程的最大线程数 (不包括主线程)
+#define NTHREAD (MAXTHREAD-1)     // 一个进程的最大线程数 (不包括主线程)
 #define PGSIZE  4096
 struct {
    int pid;
    void* ustack;
+   void* tls;       // 线程局部存储块, 通过 tp 寄存器访问
    int used;
+   int detached;    // 不再 join, 退出时由内核回收
+   volatile int exited;  // 分离的线程退出后内核置 1, 此后可以释放栈
 } threads[NTHREAD];				 // TCB 表
 
 // add a TCB to thread table
-void add_thread(int* pid, void* ustack) {
+void add_thread(int* pid, void* ustack, void* tls) {
     for(int i = 0; i < NTHREAD; i++) {
         if(threads[i].used == 0) {
             threads[i].pid = *pid;
             threads[i].ustack = ustack;
+            threads[i].tls = tls;
+            threads[i].detached = 0;
+            threads[i].exited = 0;
             threads[i].used = 1;
             break;
         }
@@ -25,14 +33,26 @@ void remove_thread(int* pid) {
     for(int i = 0; i < NTHREAD; i ++) {
         if(threads[i].used && threads[i].pid == *pid) {
             free(threads[i].ustack); 		 // 释放用户栈
+            tls_freeblock(threads[i].tls);
             threads[i].pid = 0;
             threads[i].ustack = 0;
+            threads[i].tls = 0;
             threads[i].used = 0;
             break;
         }
     }
 }
 
+// 释放已经退出的分离线程的栈
+static void reap_detached(void) {
+    for(int i = 0; i < NTHREAD; i++) {
+        if(threads[i].used && threads[i].detached && threads[i].exited) {
+            int pid = threads[i].pid;
+            remove_thread(&pid);
+        }
+    }
+}
+
 int thread_create(void (*start_routine)(void*), void* arg) {
     // If first time running any threads, initialize thread table with zeros
     static int first = 1;
@@ -41,29 +61,63 @@ int thread_create(void (*start_routine)(void*), void* arg) {
         for(int i = 0; i < NTHREAD; i++) {
             threads[i].pid = 0;
             threads[i].ustack = 0;
+            threads[i].tls = 0;
             threads[i].used = 0;
         }
     }
+    reap_detached();
     void* stack = malloc(PGSIZE);   // allocate one page for user stack
-    int pid = clone(start_routine, stack,(void*)arg); // system call for kernel thread
-    add_thread(&pid, stack);  // save new thread to thread table
+    void* tls = tls_newblock();     // and its thread-local storage
+    if(stack == 0 || tls == 0) {
+        if(stack)
+            free(stack);
+        tls_freeblock(tls);
+        return -1;
+    }
+    int pid = clone(start_routine, stack,(void*)arg, tls); // system call for kernel thread
+    if(pid < 0) {
+        free(stack);
+        tls_freeblock(tls);
+        return -1;
+    }
+    add_thread(&pid, stack, tls);  // save new thread to thread table
     return pid;
 }
 
 
 
+// 回收任意一个已退出的子线程
 int thread_join(void) {
-    for(int i = 0; i < NTHREAD; i ++) {
-        if(threads[i].used == 1) {
-            int pid = join();  		// 回收子线程
+    int pid = join(0, 0);
 
-            if(pid > 0) {
-                remove_thread(&pid);
-                return pid;
-            }
+    if(pid <= 0)
+        return 0;
+    remove_thread(&pid);
+    return pid;
+}
+
+// 等待指定线程退出, 通过 status 取回其 exit() 的值
+int thread_wait(int tid, int *status) {
+    int pid = join(tid, status);
+
+    if(pid <= 0)
+        return -1;
+    remove_thread(&pid);
+    return pid;
+}
+
+// 分离线程: 不再需要 join, 其栈在它退出后的下一次 thread_create 时释放
+int thread_detach(int tid) {
+    for(int i = 0; i < NTHREAD; i++) {
+        if(threads[i].used && threads[i].pid == tid && !threads[i].detached) {
+            threads[i].exited = 0;
+            if(detach(tid, &threads[i].exited) < 0)
+                return -1;
+            threads[i].detached = 1;
+            return 0;
         }
     }
-    return 0;
+    return -1;
 }
 
 void printTCB(void) {
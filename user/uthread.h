@@ -1,3 +1,5 @@
 int thread_create(void (*start_routine)(void*), void* arg);
 int thread_join(void);
+int thread_wait(int tid, int *status);
+int thread_detach(int tid);
 void printTCB(void);
\ No newline at end of file